@@ -1,28 +1,65 @@
 #include "cpu.h"
+#include "memsim.h"
 #include <stdio.h>
 
-void init_system(System *sys) {
+// Memory may be shared between harts (smp.c). Relaxed atomics still compile to plain
+// loads and stores, but make cross-hart accesses defined; ordering comes from the
+// SMP device's atomics and fence.
+static inline uint16_t mem_load(const System *sys, uint16_t addr) {
+    return __atomic_load_n(&sys->memory[addr], __ATOMIC_RELAXED);
+}
+
+static inline void mem_store(System *sys, uint16_t addr, uint16_t value) {
+    __atomic_store_n(&sys->memory[addr], value, __ATOMIC_RELAXED);
+}
+
+static inline void halt(System *sys, uint8_t reason) {
+    sys->running = false;
+    sys->halt_reason = reason;
+}
+
+void init_system(System *sys, uint16_t *memory) {
+    sys->memory = memory;
     for (int i = 0; i < MEM_SIZE; i++) sys->memory[i] = 0;
     for (int i = 0; i < 8; i++) sys->registers[i] = 0;
+    sys->zero_flag = false;
+    sys->neg_flag = false;
+    sys->overflow_flag = false;
+    sys->carry_flag = false;
     sys->pc = 0x0000; 
     sys->registers[0] = 0xFFFF; //SP 
     sys->running = true;
+    sys->halt_reason = HALT_NONE;
+    sys->cycles = 0;
+
+    // LD/ST may not touch code space above the first page
+    for (int i = 0; i < NUM_PAGES; i++) sys->page_flags[i] = 0;
+    for (int i = 0x01; i < (0x8000 >> PAGE_SHIFT); i++) sys->page_flags[i] = PAGE_NO_ACCESS;
+    sys->watch_hit = false;
+    sys->memsim = NULL;
+    sys->mmio_read = NULL;
+    sys->mmio_write = NULL;
+    sys->mmio_ctx = NULL;
+    sys->hart_id = 0;
 }
 
 void step_cpu(System *sys) {
     // 1. Fetch
-    uint16_t instruction = sys->memory[sys->pc];
+    uint16_t inst_pc = sys->pc;
+    if (sys->memsim) memsim_access(sys->memsim, inst_pc, MEM_FETCH, inst_pc);
+    uint16_t instruction = mem_load(sys, sys->pc);
     sys->pc++;
+    sys->cycles++;
 
     // 2. Decode
     uint16_t opcode = (instruction >> 12) & 0xF;
     uint16_t dest   = (instruction >> 9) & 0x7;
-    printf(" inst = %u\n", instruction);
+    //printf(" inst = %u\n", instruction);
 
     // 3. Execute
     switch (opcode) {
         case 0x0: // HLT
-            sys->running = false;
+            halt(sys, HALT_HLT);
             break;
             
         case 0x1: { // ADD 
@@ -115,11 +152,14 @@ void step_cpu(System *sys) {
             if (imm){
                 amount = (instruction >> 0x3) & 0x3F;
             } else{
-                amount = sys->registers[(instruction >> 0x3) & 0x3F];
+                amount = sys->registers[(instruction >> 0x3) & 0x7];
             }
+            // Counts are taken modulo 32 for shifts (16-31 shift everything out) and
+            // modulo 16 for the rotate, so large counts are defined at every -O level
+            amount &= (mode == 3) ? 15 : 31;
             //printf("%d\n", mode);
             if (mode == 0){
-                sys->registers[dest] = sys->registers[dest] << amount;
+                sys->registers[dest] = (uint32_t)sys->registers[dest] << amount;
                 //printf("SHFL %u %u => %u\n", dest, amount, sys->registers[dest]);
             } else if (mode == 1){
                 sys->registers[dest] = sys->registers[dest] >> amount;
@@ -128,7 +168,7 @@ void step_cpu(System *sys) {
                 sys->registers[dest] = (int16_t)sys->registers[dest] >> amount;
                 //printf("SHFAR %u %u => %u\n", dest, amount, sys->registers[dest]);
             } else{
-                sys->registers[dest] = (sys->registers[dest] >> amount) | (sys->registers[dest] << (16 - amount));
+                sys->registers[dest] = (sys->registers[dest] >> amount) | ((uint32_t)sys->registers[dest] << (16 - amount));
                 //printf("SHFRO %u %u => %u\n", dest, amount, sys->registers[dest]);
             }
             break;
@@ -157,13 +197,23 @@ void step_cpu(System *sys) {
             }
 
             uint16_t addr = sys->registers[r_base] + offset;
+            uint8_t flags = sys->page_flags[addr >> PAGE_SHIFT];
 
-            if (addr < 0x8000 && addr > 0x00FF) {
-                //printf("SEGFAULT: Writing to Code Space at %X\n", addr);
-                sys->running = false;
-            } else {
-                sys->registers[r_data] = sys->memory[addr];
+            if (flags & (PAGE_NO_ACCESS | PAGE_WATCH_R | PAGE_MMIO)) {
+                if (flags & PAGE_NO_ACCESS) {
+                    //printf("SEGFAULT: Writing to Code Space at %X\n", addr);
+                    halt(sys, HALT_FAULT);
+                    break;
+                }
+                if ((flags & PAGE_MMIO) && sys->mmio_read && sys->mmio_read(sys, addr, &sys->registers[r_data])) break;
+                if (flags & PAGE_WATCH_R) {
+                    sys->watch_hit = true;
+                    sys->watch_kind = PAGE_WATCH_R;
+                    sys->watch_addr = addr;
+                }
             }
+            if (sys->memsim) memsim_access(sys->memsim, addr, MEM_READ, inst_pc);
+            sys->registers[r_data] = mem_load(sys, addr);
             break;
         }
             
@@ -177,14 +227,24 @@ void step_cpu(System *sys) {
             }
 
             uint16_t addr = sys->registers[r_base] + offset;
+            uint8_t flags = sys->page_flags[addr >> PAGE_SHIFT];
 
-            if (addr < 0x8000 && addr > 0x00FF) {
-                //printf("SEGFAULT: Writing to Code Space at %X\n", addr);
-                sys->running = false;
-            } else {
-                sys->memory[addr] = sys->registers[r_data];
-                //printf("ST %u %u => %u", r_data, addr, sys->memory[addr]);
+            if (flags & (PAGE_NO_ACCESS | PAGE_WATCH_W | PAGE_MMIO)) {
+                if (flags & PAGE_NO_ACCESS) {
+                    //printf("SEGFAULT: Writing to Code Space at %X\n", addr);
+                    halt(sys, HALT_FAULT);
+                    break;
+                }
+                if ((flags & PAGE_MMIO) && sys->mmio_write && sys->mmio_write(sys, addr, sys->registers[r_data])) break;
+                if (flags & PAGE_WATCH_W) {
+                    sys->watch_hit = true;
+                    sys->watch_kind = PAGE_WATCH_W;
+                    sys->watch_addr = addr;
+                }
             }
+            if (sys->memsim) memsim_access(sys->memsim, addr, MEM_WRITE, inst_pc);
+            mem_store(sys, addr, sys->registers[r_data]);
+            //printf("ST %u %u => %u", r_data, addr, sys->memory[addr]);
             break;
         }
 
@@ -193,30 +253,33 @@ void step_cpu(System *sys) {
             if (mode == 0) {
                 if (sys->registers[0] < 0xF000) {
                     //printf("ERROR: Stack Overflow!\n");
-                    sys->running = false;
+                    halt(sys, HALT_FAULT);
                     return;
                 }
                 uint16_t val = sys->registers[(instruction >> 2) & 0x7];
                 sys->registers[0]--; 
-                sys->memory[sys->registers[7]] = val; 
+                if (sys->memsim) memsim_access(sys->memsim, sys->registers[7], MEM_WRITE, inst_pc);
+                mem_store(sys, sys->registers[7], val);
             } else if (mode == 1) {
                 if(sys->registers[0] > 0xFFFF){
                     //printf("ERROR: Stack Underflow!\n");
-                    sys->running = false;
+                    halt(sys, HALT_FAULT);
                     return;
                 }
-                uint16_t val = sys->memory[sys->registers[7]]; 
+                if (sys->memsim) memsim_access(sys->memsim, sys->registers[7], MEM_READ, inst_pc);
+                uint16_t val = mem_load(sys, sys->registers[7]);
                 sys->registers[0]++; 
                 sys->registers[(instruction >> 2) & 0x7] = val;
             } else if (mode == 2) {
                 if (sys->registers[0] < 0xF000) {
                     //printf("ERROR: Stack Overflow!\n");
-                    sys->running = false;
+                    halt(sys, HALT_FAULT);
                     return;
                 }
                 uint16_t imm = (instruction >> 2) & 0x3FF; 
                 sys->registers[0]--; 
-                sys->memory[sys->registers[7]] = imm; 
+                if (sys->memsim) memsim_access(sys->memsim, sys->registers[7], MEM_WRITE, inst_pc);
+                mem_store(sys, sys->registers[7], imm);
             } 
         }
 
@@ -277,10 +340,12 @@ void step_cpu(System *sys) {
                 if (offset & 0x400) offset |= 0xF800;
 
                 sys->registers[0]--; 
-                sys->memory[sys->registers[7]] = sys->pc;
+                if (sys->memsim) memsim_access(sys->memsim, sys->registers[7], MEM_WRITE, inst_pc);
+                mem_store(sys, sys->registers[7], sys->pc);
                 sys->pc += offset;
             } else {
-                uint16_t return_addr = sys->memory[sys->registers[7]];
+                if (sys->memsim) memsim_access(sys->memsim, sys->registers[7], MEM_READ, inst_pc);
+                uint16_t return_addr = mem_load(sys, sys->registers[7]);
                 sys->registers[7]++; 
                 sys->pc = return_addr;
             }
@@ -289,6 +354,6 @@ void step_cpu(System *sys) {
             
         default:
             printf("Unknown Opcode: %X at %X\n", opcode, sys->pc);
-            sys->running = false;
+            halt(sys, HALT_FAULT);
     }
 }
\ No newline at end of file
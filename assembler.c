@@ -73,6 +73,8 @@ typedef struct {
 typedef struct {
     uint16_t* instructions;
     int count;
+    LabelInfo* labels; // Symbol table for the debugger
+    int label_count;
 } BinaryOutput;
 
 // Helper to trim whitespace from a string (in-place)
@@ -138,7 +140,7 @@ BinaryOutput assemble(const char* source_code) {
             fprintf(stderr, "Error: Unknown opcode %s\n", mnemonic);
             free(line_copy);
             // Proper cleanup would be needed here in a real application
-            BinaryOutput result = {NULL, 0};
+            BinaryOutput result = {NULL, 0, NULL, 0};
             return result;
         }
 
@@ -290,10 +292,9 @@ BinaryOutput assemble(const char* source_code) {
     free(source_copy);
     for (int i = 0; i < line_count; i++) free(assembly_lines[i].line);
     free(assembly_lines);
-    for (int i = 0; i < label_count; i++) free(labels[i].name);
-    free(labels);
 
-    BinaryOutput result = {binary_output_data, instruction_count};
+    // Labels are handed to the caller for the symbol file
+    BinaryOutput result = {binary_output_data, instruction_count, labels, label_count};
     return result;
 }
 
@@ -362,9 +363,23 @@ int main() {
     fclose(ftxt);
     printf("Text output written to output.txt\n");
 
+    // Write the symbol table ("label address" per line) for the debugger
+    FILE *fsym = fopen("output.sym", "w");
+    if (fsym == NULL) {
+        perror("Error opening symbol file");
+        return 1;
+    }
+    for (int i = 0; i < bin_prog.label_count; i++) {
+        fprintf(fsym, "%s %04X\n", bin_prog.labels[i].name, bin_prog.labels[i].address);
+    }
+    fclose(fsym);
+    printf("Symbols written to output.sym\n");
+
 
 
     free(bin_prog.instructions);
+    for (int i = 0; i < bin_prog.label_count; i++) free(bin_prog.labels[i].name);
+    free(bin_prog.labels);
 
     return 0;
 }
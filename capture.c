@@ -0,0 +1,468 @@
+#include "capture.h"
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <io.h>
+#include <fcntl.h>
+#define dup _dup
+#define dup2 _dup2
+#define close _close
+#define fdopen _fdopen
+#else
+#include <unistd.h>
+#endif
+
+// The SSSE3 path is compiled in on every x86 GCC/Clang build and picked at run time
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <tmmintrin.h>
+#define CAPTURE_SSSE3 1
+#endif
+
+// --- STREAM SETUP ---
+
+// The VM prints its diagnostics with plain printf, so a Y4M stream on stdout
+// takes a private copy of descriptor 1 and points descriptor 1 at stderr
+static FILE *open_stdout_stream(void) {
+    fflush(stdout);
+    int fd = dup(fileno(stdout));
+    if (fd < 0) return NULL;
+    if (dup2(fileno(stderr), fileno(stdout)) < 0) {
+        close(fd);
+        return NULL;
+    }
+#ifdef _WIN32
+    _setmode(fd, _O_BINARY);
+#endif
+    FILE *stream = fdopen(fd, "wb");
+    if (stream == NULL) close(fd);
+    return stream;
+}
+
+// --- PIXEL CONVERSION ---
+
+static inline void rgb565_pixel(uint16_t p, uint8_t *out) {
+    uint8_t r = p >> 11, g = (p >> 5) & 0x3F, b = p & 0x1F;
+    out[0] = (r << 3) | (r >> 2);
+    out[1] = (g << 2) | (g >> 4);
+    out[2] = (b << 3) | (b >> 2);
+}
+
+#ifdef CAPTURE_SSSE3
+// Converts whole groups of 8 pixels, returns how many pixels were done
+__attribute__((target("ssse3")))
+static size_t rgb565_to_rgb24_ssse3(const uint16_t *src, uint8_t *dst, size_t count) {
+    size_t i = 0;
+    // 8 pixels per iteration: widen each channel in 16-bit lanes, pack to bytes,
+    // then one shuffle per output vector interleaves R, G and B
+    const __m128i mask6 = _mm_set1_epi16(0x3F);
+    const __m128i mask5 = _mm_set1_epi16(0x1F);
+    // rg holds r0..r7 g0..g7, bz holds b0..b7; -1 (0x80) zeroes the byte
+    const __m128i rg_lo = _mm_setr_epi8(0, 8, -1, 1, 9, -1, 2, 10, -1, 3, 11, -1, 4, 12, -1, 5);
+    const __m128i b_lo  = _mm_setr_epi8(-1, -1, 0, -1, -1, 1, -1, -1, 2, -1, -1, 3, -1, -1, 4, -1);
+    const __m128i rg_hi = _mm_setr_epi8(13, -1, 6, 14, -1, 7, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+    const __m128i b_hi  = _mm_setr_epi8(-1, 5, -1, -1, 6, -1, -1, 7, -1, -1, -1, -1, -1, -1, -1, -1);
+
+    for (; i + 8 <= count; i += 8) {
+        __m128i p = _mm_loadu_si128((const __m128i *)&src[i]);
+        __m128i r = _mm_srli_epi16(p, 11);
+        __m128i g = _mm_and_si128(_mm_srli_epi16(p, 5), mask6);
+        __m128i b = _mm_and_si128(p, mask5);
+        r = _mm_or_si128(_mm_slli_epi16(r, 3), _mm_srli_epi16(r, 2));
+        g = _mm_or_si128(_mm_slli_epi16(g, 2), _mm_srli_epi16(g, 4));
+        b = _mm_or_si128(_mm_slli_epi16(b, 3), _mm_srli_epi16(b, 2));
+
+        __m128i rg = _mm_packus_epi16(r, g);
+        __m128i bz = _mm_packus_epi16(b, b);
+        __m128i lo = _mm_or_si128(_mm_shuffle_epi8(rg, rg_lo), _mm_shuffle_epi8(bz, b_lo));
+        __m128i hi = _mm_or_si128(_mm_shuffle_epi8(rg, rg_hi), _mm_shuffle_epi8(bz, b_hi));
+        _mm_storeu_si128((__m128i *)&dst[i * 3], lo);
+        _mm_storel_epi64((__m128i *)&dst[i * 3 + 16], hi);
+    }
+    return i;
+}
+#endif
+
+void capture_rgb565_to_rgb24(const uint16_t *src, uint8_t *dst, size_t count) {
+    size_t i = 0;
+#ifdef CAPTURE_SSSE3
+    if (__builtin_cpu_supports("ssse3")) i = rgb565_to_rgb24_ssse3(src, dst, count);
+#endif
+    for (; i < count; i++) rgb565_pixel(src[i], &dst[i * 3]);
+}
+
+// --- IMAGE ENCODERS (writer thread) ---
+
+static int scaled_width(const Capture *cap) { return cap->width * cap->cfg.scale; }
+static int scaled_height(const Capture *cap) { return cap->height * cap->cfg.scale; }
+
+// PNG rows start with a filter-type byte, so the same buffer doubles as the PNG scanlines
+static size_t row_stride(const Capture *cap) {
+    return (cap->cfg.format == CAPTURE_PNG ? 1 : 0) + (size_t)scaled_width(cap) * 3;
+}
+
+// Converts one RGB565 frame into cap->rgb at the configured scale
+static void build_image(Capture *cap, const uint16_t *pixels) {
+    int scale = cap->cfg.scale;
+    size_t stride = row_stride(cap);
+    size_t prefix = stride - (size_t)scaled_width(cap) * 3;
+    uint8_t *src_rgb = cap->encode; // Unscaled RGB24, converted before encoding reuses the buffer
+
+    capture_rgb565_to_rgb24(pixels, src_rgb, (size_t)cap->width * cap->height);
+
+    for (int y = 0; y < cap->height; y++) {
+        uint8_t *row = &cap->rgb[(size_t)y * scale * stride];
+        const uint8_t *src = &src_rgb[(size_t)y * cap->width * 3];
+        if (prefix) row[0] = 0; // PNG filter: none
+
+        if (scale == 1) {
+            memcpy(row + prefix, src, (size_t)cap->width * 3);
+        } else {
+            uint8_t *out = row + prefix;
+            for (int x = 0; x < cap->width; x++) {
+                for (int s = 0; s < scale; s++) {
+                    memcpy(out, &src[x * 3], 3);
+                    out += 3;
+                }
+            }
+        }
+        for (int s = 1; s < scale; s++) memcpy(row + s * stride, row, stride);
+    }
+}
+
+static uint32_t crc_table[256];
+
+static void crc_init(void) {
+    for (uint32_t n = 0; n < 256; n++) {
+        uint32_t c = n;
+        for (int k = 0; k < 8; k++) c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+        crc_table[n] = c;
+    }
+}
+
+static uint32_t crc32_update(uint32_t crc, const uint8_t *data, size_t len) {
+    crc = ~crc;
+    for (size_t i = 0; i < len; i++) crc = crc_table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+
+static uint32_t adler32(const uint8_t *data, size_t len) {
+    uint32_t a = 1, b = 0;
+    while (len > 0) {
+        size_t n = len < 5552 ? len : 5552; // Largest run before the sums can overflow
+        len -= n;
+        while (n--) {
+            a += *data++;
+            b += a;
+        }
+        a %= 65521;
+        b %= 65521;
+    }
+    return (b << 16) | a;
+}
+
+static uint8_t *put_be32(uint8_t *p, uint32_t v) {
+    p[0] = v >> 24;
+    p[1] = v >> 16;
+    p[2] = v >> 8;
+    p[3] = v;
+    return p + 4;
+}
+
+// Writes length, type, data and CRC; data must already sit at p + 8
+static uint8_t *png_chunk(uint8_t *p, const char *type, size_t len) {
+    put_be32(p, (uint32_t)len);
+    memcpy(p + 4, type, 4);
+    return put_be32(p + 8 + len, crc32_update(0, p + 4, len + 4));
+}
+
+// Upper bound of the encoded PNG size: zlib stored blocks add 5 bytes per 64 KB
+static size_t png_size(size_t raw) {
+    return 8 + (12 + 13) + (12 + 2 + raw + 5 * (raw / 65535 + 1) + 4) + 12;
+}
+
+static size_t encode_png(Capture *cap) {
+    size_t raw = row_stride(cap) * scaled_height(cap);
+    uint8_t *p = cap->encode;
+
+    memcpy(p, "\x89PNG\r\n\x1a\n", 8);
+    p += 8;
+
+    uint8_t *ihdr = p + 8;
+    put_be32(ihdr, scaled_width(cap));
+    put_be32(ihdr + 4, scaled_height(cap));
+    ihdr[8] = 8;  // Bits per channel
+    ihdr[9] = 2;  // Truecolour
+    ihdr[10] = 0; // Deflate
+    ihdr[11] = 0; // Adaptive filtering
+    ihdr[12] = 0; // No interlace
+    p = png_chunk(p, "IHDR", 13);
+
+    // zlib stream of stored (uncompressed) deflate blocks
+    uint8_t *idat = p + 8;
+    uint8_t *z = idat;
+    *z++ = 0x78;
+    *z++ = 0x01;
+    const uint8_t *src = cap->rgb;
+    size_t left = raw;
+    do {
+        uint16_t n = left > 65535 ? 65535 : (uint16_t)left;
+        left -= n;
+        *z++ = left == 0; // BFINAL, BTYPE = stored
+        *z++ = n & 0xFF;
+        *z++ = n >> 8;
+        *z++ = ~n & 0xFF;
+        *z++ = (uint16_t)~n >> 8;
+        memcpy(z, src, n);
+        z += n;
+        src += n;
+    } while (left > 0);
+    z = put_be32(z, adler32(cap->rgb, raw));
+    p = png_chunk(p, "IDAT", z - idat);
+
+    p = png_chunk(p, "IEND", 0);
+    return p - cap->encode;
+}
+
+// BT.601 studio range, integer approximation
+static size_t encode_y4m(Capture *cap) {
+    size_t plane = (size_t)scaled_width(cap) * scaled_height(cap);
+    uint8_t *y = cap->encode;
+    uint8_t *cb = y + plane;
+    uint8_t *cr = cb + plane;
+
+    for (size_t i = 0; i < plane; i++) {
+        int r = cap->rgb[i * 3], g = cap->rgb[i * 3 + 1], b = cap->rgb[i * 3 + 2];
+        y[i]  = (uint8_t)(((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
+        cb[i] = (uint8_t)(((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128);
+        cr[i] = (uint8_t)(((112 * r - 94 * g - 18 * b + 128) >> 8) + 128);
+    }
+    return plane * 3;
+}
+
+static bool write_sequence_frame(Capture *cap, uint64_t number) {
+    const char *ext = cap->cfg.format == CAPTURE_PNG ? "png" : "ppm";
+    char path[512];
+    snprintf(path, sizeof(path), "%s%06llu.%s", cap->cfg.path, (unsigned long long)number, ext);
+
+    FILE *f = fopen(path, "wb");
+    if (f == NULL) {
+        perror(path);
+        return false;
+    }
+
+    bool ok;
+    if (cap->cfg.format == CAPTURE_PNG) {
+        size_t len = encode_png(cap);
+        ok = fwrite(cap->encode, 1, len, f) == len;
+    } else {
+        size_t len = row_stride(cap) * scaled_height(cap);
+        ok = fprintf(f, "P6\n%d %d\n255\n", scaled_width(cap), scaled_height(cap)) > 0 &&
+             fwrite(cap->rgb, 1, len, f) == len;
+    }
+    if (fclose(f) != 0) ok = false;
+    if (!ok) fprintf(stderr, "Error writing %s\n", path);
+    return ok;
+}
+
+static bool write_frame(Capture *cap, const CaptureSlot *slot, const uint16_t *pixels) {
+    if (cap->cfg.format != CAPTURE_Y4M) {
+        build_image(cap, pixels);
+        return write_sequence_frame(cap, slot->number);
+    }
+
+    // A repeated frame re-sends the previous YUV planes, keeping the stream's timing
+    size_t len = (size_t)scaled_width(cap) * scaled_height(cap) * 3;
+    if (!slot->repeat) {
+        build_image(cap, pixels);
+        encode_y4m(cap);
+    }
+    if (fputs("FRAME\n", cap->stream) == EOF || fwrite(cap->encode, 1, len, cap->stream) != len) {
+        perror("Error writing Y4M stream");
+        return false;
+    }
+    return true;
+}
+
+// --- WRITER THREAD ---
+
+static void *writer_thread(void *arg) {
+    Capture *cap = arg;
+    size_t frame_words = (size_t)cap->width * cap->height;
+
+    pthread_mutex_lock(&cap->lock);
+    for (;;) {
+        while (cap->count == 0 && !cap->closing) pthread_cond_wait(&cap->ready, &cap->lock);
+        if (cap->count == 0) break; // Closing and drained
+
+        // The slot stays owned by the writer until count drops, so the CPU loop never touches it
+        int index = cap->head;
+        CaptureSlot slot = cap->slots[index];
+        pthread_mutex_unlock(&cap->lock);
+
+        if (!cap->failed) {
+            if (write_frame(cap, &slot, &cap->pixels[index * frame_words])) cap->written++;
+            else cap->failed = true; // Keep draining so the CPU side never waits
+        }
+
+        pthread_mutex_lock(&cap->lock);
+        cap->head = (cap->head + 1) % CAPTURE_QUEUE_SIZE;
+        cap->count--;
+        pthread_cond_signal(&cap->space);
+    }
+    pthread_mutex_unlock(&cap->lock);
+    return NULL;
+}
+
+// --- SETUP ---
+
+bool capture_parse_spec(const char *spec, CaptureConfig *cfg) {
+    const char *colon = strchr(spec, ':');
+    if (colon == NULL || colon[1] == '\0') return false;
+
+    size_t fmt_len = colon - spec;
+    if (fmt_len == 3 && strncmp(spec, "ppm", 3) == 0) cfg->format = CAPTURE_PPM;
+    else if (fmt_len == 3 && strncmp(spec, "png", 3) == 0) cfg->format = CAPTURE_PNG;
+    else if (fmt_len == 3 && strncmp(spec, "y4m", 3) == 0) cfg->format = CAPTURE_Y4M;
+    else return false;
+
+    const char *path = colon + 1;
+    size_t len = strlen(path);
+    cfg->scale = 1;
+    cfg->lossless = false;
+
+    // A trailing ":N" is the scale; other colons belong to the path (C:\frames\...)
+    const char *last = strrchr(path, ':');
+    if (last != NULL && last[1] != '\0' && strspn(last + 1, "0123456789") == strlen(last + 1)) {
+        cfg->scale = atoi(last + 1);
+        if (cfg->scale < 1 || cfg->scale > CAPTURE_MAX_SCALE) return false;
+        len = last - path;
+    }
+    if (len == 0 || len >= sizeof(cfg->path)) return false;
+    memcpy(cfg->path, path, len);
+    cfg->path[len] = '\0';
+    return true;
+}
+
+bool capture_open(Capture *cap, const CaptureConfig *cfg, int width, int height) {
+    memset(cap, 0, sizeof(*cap));
+    cap->cfg = *cfg;
+    cap->width = width;
+    cap->height = height;
+    crc_init();
+
+    size_t frame_words = (size_t)width * height;
+    size_t image = row_stride(cap) * scaled_height(cap);
+    // Holds the unscaled conversion, then the PNG file or the Y4M planes
+    size_t encode = cfg->format == CAPTURE_PNG ? png_size(image) : image;
+    if (encode < frame_words * 3) encode = frame_words * 3;
+
+    cap->last = malloc(frame_words * sizeof(uint16_t));
+    cap->pixels = malloc(CAPTURE_QUEUE_SIZE * frame_words * sizeof(uint16_t));
+    cap->rgb = malloc(image);
+    cap->encode = malloc(encode);
+    if (cap->last == NULL || cap->pixels == NULL || cap->rgb == NULL || cap->encode == NULL) {
+        fprintf(stderr, "Error allocating capture buffers\n");
+        capture_close(cap);
+        return false;
+    }
+
+    if (cfg->format == CAPTURE_Y4M) {
+        cap->stream = strcmp(cfg->path, "-") == 0 ? open_stdout_stream() : fopen(cfg->path, "wb");
+        if (cap->stream == NULL) {
+            perror(cfg->path);
+            capture_close(cap);
+            return false;
+        }
+        fprintf(cap->stream, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C444\n",
+                scaled_width(cap), scaled_height(cap), CAPTURE_FPS);
+    }
+
+    pthread_mutex_init(&cap->lock, NULL);
+    pthread_cond_init(&cap->ready, NULL);
+    pthread_cond_init(&cap->space, NULL);
+    if (pthread_create(&cap->thread, NULL, writer_thread, cap) != 0) {
+        fprintf(stderr, "Error starting capture writer\n");
+        pthread_mutex_destroy(&cap->lock);
+        pthread_cond_destroy(&cap->ready);
+        pthread_cond_destroy(&cap->space);
+        capture_close(cap);
+        return false;
+    }
+    cap->thread_started = true;
+    return true;
+}
+
+void capture_close(Capture *cap) {
+    if (cap->thread_started) {
+        pthread_mutex_lock(&cap->lock);
+        cap->closing = true;
+        pthread_cond_signal(&cap->ready);
+        pthread_mutex_unlock(&cap->lock);
+        pthread_join(cap->thread, NULL);
+        pthread_mutex_destroy(&cap->lock);
+        pthread_cond_destroy(&cap->ready);
+        pthread_cond_destroy(&cap->space);
+        cap->thread_started = false;
+
+        fprintf(stderr, "Captured %llu frames (%llu seen, %llu dropped).\n", (unsigned long long)cap->written,
+               (unsigned long long)cap->frame, (unsigned long long)cap->dropped);
+    }
+
+    if (cap->stream != NULL) fclose(cap->stream);
+    cap->stream = NULL;
+    free(cap->last);
+    free(cap->pixels);
+    free(cap->rgb);
+    free(cap->encode);
+    cap->last = NULL;
+    cap->pixels = NULL;
+    cap->rgb = NULL;
+    cap->encode = NULL;
+}
+
+// --- CPU SIDE ---
+
+void capture_frame(Capture *cap, const uint16_t *pixels) {
+    size_t frame_bytes = (size_t)cap->width * cap->height * sizeof(uint16_t);
+    uint64_t number = cap->frame++;
+
+    // Deduplication: image sequences skip unchanged frames, Y4M queues a cheap repeat
+    bool repeat = cap->have_last && memcmp(cap->last, pixels, frame_bytes) == 0;
+    if (repeat && cap->cfg.format != CAPTURE_Y4M) return;
+
+    // The writer only holds the lock for bookkeeping, never while encoding or writing
+    pthread_mutex_lock(&cap->lock);
+    // Lossless captures wait for the writer, so every frame reaches disk at any host speed
+    while (cap->cfg.lossless && cap->count == CAPTURE_QUEUE_SIZE) pthread_cond_wait(&cap->space, &cap->lock);
+    if (cap->count == CAPTURE_QUEUE_SIZE) {
+        // Full: the newest waiting frame is replaced, so the latest screen is never lost.
+        // The writer only owns the head slot, and the queue holds more than one.
+        cap->dropped++;
+        if (!repeat) {
+            int newest = (cap->head + cap->count - 1) % CAPTURE_QUEUE_SIZE;
+            memcpy(&cap->pixels[newest * (frame_bytes / sizeof(uint16_t))], pixels, frame_bytes);
+            memcpy(cap->last, pixels, frame_bytes);
+            cap->slots[newest].number = number;
+            cap->slots[newest].repeat = false;
+        }
+        pthread_mutex_unlock(&cap->lock);
+        return;
+    }
+    int index = (cap->head + cap->count) % CAPTURE_QUEUE_SIZE;
+    pthread_mutex_unlock(&cap->lock);
+
+    // Only the CPU side adds slots, so this one stays free while it is filled
+    if (!repeat) {
+        memcpy(&cap->pixels[index * (frame_bytes / sizeof(uint16_t))], pixels, frame_bytes);
+        memcpy(cap->last, pixels, frame_bytes);
+        cap->have_last = true;
+    }
+    cap->slots[index].number = number;
+    cap->slots[index].repeat = repeat;
+
+    pthread_mutex_lock(&cap->lock);
+    cap->count++;
+    pthread_cond_signal(&cap->ready);
+    pthread_mutex_unlock(&cap->lock);
+}
@@ -0,0 +1,77 @@
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+// Configuration
+#define CAPTURE_QUEUE_SIZE 32 // Frames waiting for the writer; when full the newest is replaced, or the CPU waits if lossless
+#define CAPTURE_MAX_SCALE 16
+#define CAPTURE_FPS 60        // Y4M frame rate, one frame per main-loop iteration
+
+typedef enum {
+    CAPTURE_PPM, // prefix000000.ppm, prefix000001.ppm, ...
+    CAPTURE_PNG, // prefix000000.png, ... (uncompressed deflate, no zlib needed)
+    CAPTURE_Y4M, // One YUV4MPEG2 stream, 4:4:4
+} CaptureFormat;
+
+typedef struct {
+    CaptureFormat format;
+    char path[256]; // File name prefix for sequences, stream file for Y4M ("-" = stdout)
+    int scale;        // Integer upscale factor, nearest neighbour
+    bool lossless;    // Block the CPU loop while the queue is full instead of dropping (headless)
+} CaptureConfig;
+
+// A frame handed from the CPU loop to the writer thread
+typedef struct {
+    uint64_t number; // Frame index since capture started
+    bool repeat;     // Unchanged since the last queued frame, no pixels copied
+} CaptureSlot;
+
+typedef struct {
+    CaptureConfig cfg;
+    int width;  // Source size in pixels
+    int height;
+    FILE *stream; // Y4M only
+
+    // CPU side
+    uint16_t *last;   // Last queued frame, for deduplication
+    bool have_last;
+    uint64_t frame;   // Frames seen so far
+    uint64_t dropped; // Frames lost because the queue was full
+
+    // Ring buffer between the CPU loop and the writer, guarded by lock
+    CaptureSlot slots[CAPTURE_QUEUE_SIZE];
+    uint16_t *pixels; // CAPTURE_QUEUE_SIZE frames of RGB565
+    int head;
+    int count;
+    bool closing;
+    pthread_t thread;
+    bool thread_started;
+    pthread_mutex_t lock;
+    pthread_cond_t ready;
+    pthread_cond_t space; // Signalled when the writer frees a slot
+
+    // Writer side
+    uint8_t *rgb;    // Scaled RGB24 image
+    uint8_t *encode; // Scratch for the file encoding
+    uint64_t written;
+    bool failed;
+} Capture;
+
+// Function Prototypes
+bool capture_parse_spec(const char *spec, CaptureConfig *cfg); // "ppm|png|y4m:path[:scale]"
+bool capture_open(Capture *cap, const CaptureConfig *cfg, int width, int height);
+void capture_close(Capture *cap); // Drains the queue and joins the writer
+
+// Copies the frame into the queue (or notes a repeat) and returns. Only blocks when
+// the capture is lossless and the writer is 32 frames behind.
+void capture_frame(Capture *cap, const uint16_t *pixels);
+
+// RGB565 to packed RGB24, 5/6-bit channels widened by bit replication
+void capture_rgb565_to_rgb24(const uint16_t *src, uint8_t *dst, size_t count);
+
+#endif
@@ -6,10 +6,25 @@
 
 // Configuration
 #define MEM_SIZE 65536
+#define PAGE_SHIFT 8                       // 256-word pages
+#define NUM_PAGES (MEM_SIZE >> PAGE_SHIFT)
 
-// The System State
-typedef struct {
-    uint16_t memory[MEM_SIZE];
+// Page flags: LD/ST only leave the fast path when a relevant bit is set
+#define PAGE_NO_ACCESS 0x01 // Code space, LD/ST halt the machine
+#define PAGE_WATCH_R   0x02 // Debugger read watchpoint somewhere on the page
+#define PAGE_WATCH_W   0x04 // Debugger write watchpoint somewhere on the page
+#define PAGE_MMIO      0x08 // Device registers on the page, LD/ST ask mmio_read/mmio_write first
+
+// Why a CPU stopped (System.halt_reason)
+#define HALT_NONE  0
+#define HALT_HLT   1 // HLT instruction; a hart in a multi-hart run resumes on mailbox mail
+#define HALT_FAULT 2 // Stack overflow, code-space LD/ST or unknown opcode
+
+// The System State: one CPU. Its MEM_SIZE words of memory live outside the struct
+// (main's RAM, or the block shared between harts), so copying a System copies the
+// pointer and both copies write the same memory.
+typedef struct System {
+    uint16_t *memory;
     uint16_t registers[8];
     uint16_t pc;   
     uint16_t ir;
@@ -17,16 +32,32 @@ typedef struct {
     uint16_t mar;
     uint16_t mbr;
     bool running;
+    uint8_t halt_reason; // HALT_* once running is false
+    uint64_t cycles; // Instructions executed since init_system
     
     // Flags
     bool zero_flag;
     bool neg_flag;
     bool overflow_flag;
     bool carry_flag;
+
+    // Memory Protection
+    uint8_t page_flags[NUM_PAGES];
+    bool watch_hit;      // Set when LD/ST touches a watched page
+    uint8_t watch_kind;  // PAGE_WATCH_R or PAGE_WATCH_W
+    uint16_t watch_addr;
+
+    struct MemSim *memsim; // Optional cache/TLB model, NULL when off
+
+    // Memory-mapped devices; return false to fall back to plain memory
+    bool (*mmio_read)(struct System *sys, uint16_t addr, uint16_t *value);
+    bool (*mmio_write)(struct System *sys, uint16_t addr, uint16_t value);
+    void *mmio_ctx;
+    uint16_t hart_id;
 } System;
 
 // Function Prototypes (Promises that these functions exist)
-void init_system(System *sys);
+void init_system(System *sys, uint16_t *memory); // Zeroes memory and resets the CPU
 void step_cpu(System *sys);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,181 @@
+#include "debug.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+void debug_init(Debugger *dbg) {
+    memset(dbg, 0, sizeof(*dbg));
+}
+
+void debug_free(Debugger *dbg) {
+    free(dbg->symbols);
+    dbg->symbols = NULL;
+    dbg->symbol_count = 0;
+}
+
+// --- BREAKPOINTS ---
+
+void debug_set_breakpoint(Debugger *dbg, uint16_t addr) {
+    dbg->breakpoints[addr >> 6] |= (uint64_t)1 << (addr & 63);
+}
+
+void debug_clear_breakpoint(Debugger *dbg, uint16_t addr) {
+    dbg->breakpoints[addr >> 6] &= ~((uint64_t)1 << (addr & 63));
+}
+
+// --- WATCHPOINTS ---
+
+// Rebuilds the watch bits of the page table from the watch list
+static void refresh_watch_pages(const Debugger *dbg, System *sys) {
+    for (int p = 0; p < NUM_PAGES; p++) sys->page_flags[p] &= ~(PAGE_WATCH_R | PAGE_WATCH_W);
+
+    for (int i = 0; i < dbg->watch_count; i++) {
+        const Watchpoint *w = &dbg->watch[i];
+        uint32_t first = w->addr >> PAGE_SHIFT;
+        uint32_t last = ((uint32_t)w->addr + w->len - 1) >> PAGE_SHIFT;
+        for (uint32_t p = first; p <= last && p < NUM_PAGES; p++) sys->page_flags[p] |= w->kind;
+    }
+}
+
+bool debug_add_watch(Debugger *dbg, System *sys, uint16_t addr, uint16_t len, uint8_t kind) {
+    if (dbg->watch_count == DEBUG_MAX_WATCH || len == 0) return false;
+
+    Watchpoint *w = &dbg->watch[dbg->watch_count++];
+    w->addr = addr;
+    w->len = len;
+    w->kind = kind & (PAGE_WATCH_R | PAGE_WATCH_W);
+    refresh_watch_pages(dbg, sys);
+    return true;
+}
+
+bool debug_remove_watch(Debugger *dbg, System *sys, uint16_t addr, uint16_t len, uint8_t kind) {
+    for (int i = 0; i < dbg->watch_count; i++) {
+        Watchpoint *w = &dbg->watch[i];
+        if (w->addr == addr && w->len == len && w->kind == kind) {
+            *w = dbg->watch[--dbg->watch_count];
+            refresh_watch_pages(dbg, sys);
+            return true;
+        }
+    }
+    return false;
+}
+
+// The page table only says "somewhere on this page"; check the exact range here
+static bool watch_matches(const Debugger *dbg, uint16_t addr, uint8_t kind) {
+    for (int i = 0; i < dbg->watch_count; i++) {
+        const Watchpoint *w = &dbg->watch[i];
+        if ((w->kind & kind) && addr >= w->addr && (uint32_t)addr < (uint32_t)w->addr + w->len) return true;
+    }
+    return false;
+}
+
+// --- EXECUTION ---
+
+// Runs one instruction and reports a watchpoint stop if it touched a watched word
+static bool step_watched(Debugger *dbg, System *sys, Replay *rp) {
+    sys->watch_hit = false;
+    replay_step(rp, sys);
+    if (sys->watch_hit && watch_matches(dbg, sys->watch_addr, sys->watch_kind)) {
+        dbg->watch_addr = sys->watch_addr;
+        dbg->watch_kind = sys->watch_kind;
+        return true;
+    }
+    return false;
+}
+
+StopReason debug_run(Debugger *dbg, System *sys, Replay *rp, uint32_t max_steps) {
+    // Resuming from a breakpoint executes it once without stopping
+    if (dbg->resuming && max_steps > 0) {
+        dbg->resuming = false;
+        if (!sys->running) return STOP_HALTED;
+        if (step_watched(dbg, sys, rp)) return STOP_WATCHPOINT;
+        max_steps--;
+    }
+
+    for (uint32_t i = 0; i < max_steps; i++) {
+        if (!sys->running) return STOP_HALTED;
+        if (debug_is_breakpoint(dbg, sys->pc)) return STOP_BREAKPOINT;
+        if (step_watched(dbg, sys, rp)) return STOP_WATCHPOINT;
+    }
+    return sys->running ? STOP_NONE : STOP_HALTED;
+}
+
+StopReason debug_step(Debugger *dbg, System *sys, Replay *rp) {
+    dbg->resuming = false;
+    if (!sys->running) return STOP_HALTED;
+    if (step_watched(dbg, sys, rp)) return STOP_WATCHPOINT;
+    return STOP_STEP;
+}
+
+StopReason debug_reverse_step(Debugger *dbg, System *sys, Replay *rp) {
+    (void)dbg;
+    replay_step_back(rp, sys);
+    sys->watch_hit = false;
+    return STOP_STEP;
+}
+
+typedef struct {
+    Debugger *dbg;
+    StopReason reason; // Kind of the latest match seen so far
+    uint16_t watch_addr;
+    uint8_t watch_kind;
+} ReverseScan;
+
+// A breakpoint matches before the instruction at it runs, a watchpoint after the access
+static bool reverse_hit(System *sys, bool ran, void *ctx) {
+    ReverseScan *scan = ctx;
+    if (!ran) {
+        sys->watch_hit = false;
+        if (!debug_is_breakpoint(scan->dbg, sys->pc)) return false;
+        scan->reason = STOP_BREAKPOINT;
+        return true;
+    }
+    if (!sys->watch_hit || !watch_matches(scan->dbg, sys->watch_addr, sys->watch_kind)) return false;
+    scan->reason = STOP_WATCHPOINT;
+    scan->watch_addr = sys->watch_addr;
+    scan->watch_kind = sys->watch_kind;
+    return true;
+}
+
+StopReason debug_reverse_continue(Debugger *dbg, System *sys, Replay *rp) {
+    ReverseScan scan = { dbg, STOP_STEP, 0, 0 };
+    bool hit = replay_reverse_continue(rp, sys, reverse_hit, &scan);
+    sys->watch_hit = false;
+    if (!hit) return STOP_STEP;
+    if (scan.reason == STOP_WATCHPOINT) {
+        // Stopped before the instruction that made the access, as GDB expects going backwards
+        dbg->watch_addr = scan.watch_addr;
+        dbg->watch_kind = scan.watch_kind;
+    }
+    return scan.reason;
+}
+
+// --- SYMBOLS ---
+
+bool debug_load_symbols(Debugger *dbg, const char *path) {
+    FILE *f = fopen(path, "r");
+    if (f == NULL) return false;
+
+    char name[DEBUG_SYMBOL_LEN];
+    unsigned int address;
+    while (fscanf(f, "%31s %x", name, &address) == 2) {
+        Symbol *symbols = realloc(dbg->symbols, (dbg->symbol_count + 1) * sizeof(Symbol));
+        if (symbols == NULL) break;
+        dbg->symbols = symbols;
+        strcpy(dbg->symbols[dbg->symbol_count].name, name);
+        dbg->symbols[dbg->symbol_count].address = (uint16_t)address;
+        dbg->symbol_count++;
+    }
+    fclose(f);
+    return true;
+}
+
+bool debug_find_symbol(const Debugger *dbg, const char *name, uint16_t *address) {
+    for (int i = 0; i < dbg->symbol_count; i++) {
+        if (strcmp(dbg->symbols[i].name, name) == 0) {
+            *address = dbg->symbols[i].address;
+            return true;
+        }
+    }
+    return false;
+}
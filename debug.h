@@ -0,0 +1,71 @@
+#ifndef DEBUG_H
+#define DEBUG_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "cpu.h"
+#include "replay.h"
+
+// Configuration
+#define DEBUG_MAX_WATCH 16
+#define DEBUG_SYMBOL_LEN 32
+
+typedef enum {
+    STOP_NONE,       // Instruction budget used up, still running
+    STOP_STEP,       // Single step finished
+    STOP_BREAKPOINT,
+    STOP_WATCHPOINT,
+    STOP_HALTED,     // HLT, fault or quit input
+    STOP_INTERRUPT,  // Stopped on request of the debugger front end
+} StopReason;
+
+typedef struct {
+    uint16_t addr;
+    uint16_t len;   // In words
+    uint8_t kind;   // PAGE_WATCH_R and/or PAGE_WATCH_W
+} Watchpoint;
+
+typedef struct {
+    char name[DEBUG_SYMBOL_LEN];
+    uint16_t address;
+} Symbol;
+
+typedef struct {
+    uint64_t breakpoints[MEM_SIZE / 64]; // One bit per instruction address
+    Watchpoint watch[DEBUG_MAX_WATCH];
+    int watch_count;
+    bool resuming; // Next debug_run steps over a breakpoint at the current PC
+
+    Symbol *symbols;
+    int symbol_count;
+
+    // Details of the last watchpoint stop
+    uint16_t watch_addr;
+    uint8_t watch_kind;
+} Debugger;
+
+static inline bool debug_is_breakpoint(const Debugger *dbg, uint16_t addr) {
+    return (dbg->breakpoints[addr >> 6] >> (addr & 63)) & 1;
+}
+
+// Function Prototypes
+void debug_init(Debugger *dbg);
+void debug_free(Debugger *dbg);
+
+void debug_set_breakpoint(Debugger *dbg, uint16_t addr);
+void debug_clear_breakpoint(Debugger *dbg, uint16_t addr);
+bool debug_add_watch(Debugger *dbg, System *sys, uint16_t addr, uint16_t len, uint8_t kind);
+bool debug_remove_watch(Debugger *dbg, System *sys, uint16_t addr, uint16_t len, uint8_t kind);
+
+// Runs up to max_steps instructions, stopping early on a breakpoint, watchpoint or halt.
+// Only called while debugging, so normal runs never pay for the breakpoint check.
+StopReason debug_run(Debugger *dbg, System *sys, Replay *rp, uint32_t max_steps);
+StopReason debug_step(Debugger *dbg, System *sys, Replay *rp);
+StopReason debug_reverse_step(Debugger *dbg, System *sys, Replay *rp);
+StopReason debug_reverse_continue(Debugger *dbg, System *sys, Replay *rp);
+
+// Symbols written by the assembler ("label address" per line)
+bool debug_load_symbols(Debugger *dbg, const char *path);
+bool debug_find_symbol(const Debugger *dbg, const char *name, uint16_t *address);
+
+#endif
@@ -0,0 +1,598 @@
+#include "gdbstub.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#define CLOSE_SOCKET closesocket
+#else
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#define CLOSE_SOCKET close
+#endif
+
+// A client that disconnects mid-reply must not kill the VM with SIGPIPE
+#ifdef MSG_NOSIGNAL
+#define SEND_FLAGS MSG_NOSIGNAL
+#else
+#define SEND_FLAGS 0
+#endif
+
+static const char HEX[] = "0123456789abcdef";
+
+// --- SOCKET HELPERS ---
+
+static void set_nonblocking(intptr_t fd) {
+#ifdef _WIN32
+    u_long mode = 1;
+    ioctlsocket((SOCKET)fd, FIONBIO, &mode);
+#else
+    fcntl((int)fd, F_SETFL, fcntl((int)fd, F_GETFL, 0) | O_NONBLOCK);
+#endif
+}
+
+static bool would_block(void) {
+#ifdef _WIN32
+    return WSAGetLastError() == WSAEWOULDBLOCK;
+#else
+    return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+#endif
+}
+
+static void drop_client(GdbStub *gdb) {
+    CLOSE_SOCKET(gdb->client_fd);
+    gdb->client_fd = -1;
+    gdb->running = false;
+}
+
+static void send_all(GdbStub *gdb, const char *data, size_t len) {
+    while (len > 0 && gdb->client_fd >= 0) {
+        long n = send(gdb->client_fd, data, len, SEND_FLAGS);
+        if (n > 0) {
+            data += n;
+            len -= n;
+        } else if (!would_block()) {
+            drop_client(gdb);
+            gdb->attached = false;
+        }
+    }
+}
+
+static void send_packet(GdbStub *gdb, const char *body) {
+    char frame[GDB_BUF_SIZE + 4];
+    uint8_t sum = 0;
+    size_t len = 0;
+
+    frame[len++] = '$';
+    for (const char *p = body; *p && len < GDB_BUF_SIZE; p++) {
+        frame[len++] = *p;
+        sum += (uint8_t)*p;
+    }
+    frame[len++] = '#';
+    frame[len++] = HEX[sum >> 4];
+    frame[len++] = HEX[sum & 0xF];
+    send_all(gdb, frame, len);
+}
+
+// --- HEX HELPERS ---
+
+static int hex_digit(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+static void put_hex_le(char *out, uint32_t value, int bytes) {
+    // Little-endian byte order, as GDB expects for register and memory dumps
+    for (int i = 0; i < bytes; i++, value >>= 8) {
+        out[i * 2] = HEX[(value >> 4) & 0xF];
+        out[i * 2 + 1] = HEX[value & 0xF];
+    }
+}
+
+static uint32_t get_hex_le(const char *in, int bytes) {
+    uint32_t value = 0;
+    for (int i = 0; i < bytes; i++) {
+        value |= (uint32_t)((hex_digit(in[i * 2]) << 4) | hex_digit(in[i * 2 + 1])) << (i * 8);
+    }
+    return value;
+}
+
+// --- REGISTERS AND MEMORY ---
+
+#define GDB_NUM_REGS 10
+#define GDB_REGS_HEX (9 * 4 + 8) // 'g' reply length: nine 16-bit registers and the 32-bit pc
+
+// Served through qXfer to clients that read a target description. There is no
+// <architecture> element: GDB has no port for this ISA, and naming one it does
+// know would make it decode the registers as that CPU instead.
+// Like every GDB address, pc holds a byte address (word * 2), so it needs 17 bits.
+static const char TARGET_XML[] =
+    "<?xml version=\"1.0\"?>"
+    "<!DOCTYPE target SYSTEM \"gdb-target.dtd\">"
+    "<target version=\"1.0\">"
+    "<feature name=\"org.vm16.core\">"
+    "<reg name=\"r0\" bitsize=\"16\" type=\"uint16\" regnum=\"0\"/>"
+    "<reg name=\"r1\" bitsize=\"16\" type=\"uint16\"/>"
+    "<reg name=\"r2\" bitsize=\"16\" type=\"uint16\"/>"
+    "<reg name=\"r3\" bitsize=\"16\" type=\"uint16\"/>"
+    "<reg name=\"r4\" bitsize=\"16\" type=\"uint16\"/>"
+    "<reg name=\"r5\" bitsize=\"16\" type=\"uint16\"/>"
+    "<reg name=\"r6\" bitsize=\"16\" type=\"uint16\"/>"
+    "<reg name=\"r7\" bitsize=\"16\" type=\"uint16\"/>"
+    "<reg name=\"pc\" bitsize=\"32\" type=\"code_ptr\"/>"
+    "<reg name=\"flags\" bitsize=\"16\" type=\"uint16\"/>"
+    "</feature>"
+    "</target>";
+
+static int register_bytes(int n) {
+    return n == 8 ? 4 : 2;
+}
+
+static uint32_t read_register(const System *sys, int n) {
+    if (n < 8) return sys->registers[n];
+    if (n == 8) return (uint32_t)sys->pc * 2;
+    return sys->zero_flag | (sys->neg_flag << 1) | (sys->overflow_flag << 2) | (sys->carry_flag << 3);
+}
+
+// State edits go through the replay log so reverse execution and seeks replay them
+static void write_register(System *sys, Replay *rp, int n, uint32_t value) {
+    if (n == 8) value /= 2;
+    replay_record_input(rp, sys, INPUT_WRITE_REG, n, (uint16_t)value);
+}
+
+static uint8_t read_byte(const System *sys, uint32_t addr) {
+    uint16_t word = sys->memory[(addr >> 1) & (MEM_SIZE - 1)];
+    return (addr & 1) ? word >> 8 : word & 0xFF;
+}
+
+static void write_byte(System *sys, Replay *rp, uint32_t addr, uint8_t value) {
+    uint16_t index = (addr >> 1) & (MEM_SIZE - 1);
+    uint16_t word = sys->memory[index];
+    if (addr & 1) word = (word & 0x00FF) | (value << 8);
+    else word = (word & 0xFF00) | value;
+    replay_record_input(rp, sys, INPUT_WRITE_MEM, index, word);
+}
+
+// --- STOP REPLIES ---
+
+static void send_stop(GdbStub *gdb, const Debugger *dbg, const System *sys, StopReason reason) {
+    char reply[64];
+    switch (reason) {
+        case STOP_BREAKPOINT:
+            strcpy(reply, "T05swbreak:;");
+            break;
+        case STOP_WATCHPOINT:
+            snprintf(reply, sizeof(reply), "T05%s:%x;",
+                     dbg->watch_kind == PAGE_WATCH_W ? "watch" : "rwatch", dbg->watch_addr * 2);
+            break;
+        case STOP_INTERRUPT:
+            strcpy(reply, "T02");
+            break;
+        case STOP_HALTED:
+            // A fault stops like SIGSEGV so it can be inspected; HLT and quit end the program
+            strcpy(reply, sys->halt_reason == HALT_FAULT ? "T0b" : "W00");
+            break;
+        default:
+            strcpy(reply, "T05");
+    }
+    send_packet(gdb, reply);
+}
+
+// --- MONITOR COMMANDS ---
+
+static void monitor_output(GdbStub *gdb, const char *text) {
+    char reply[GDB_BUF_SIZE];
+    size_t len = 0;
+    reply[len++] = 'O';
+    for (const char *p = text; *p && len + 2 < sizeof(reply); p++) {
+        reply[len++] = HEX[(uint8_t)*p >> 4];
+        reply[len++] = HEX[*p & 0xF];
+    }
+    reply[len] = '\0';
+    send_packet(gdb, reply);
+}
+
+static void handle_monitor(GdbStub *gdb, Debugger *dbg, System *sys, Replay *rp, const char *hex) {
+    char cmd[256];
+    size_t len = 0;
+    while (hex[0] && hex[1] && len + 1 < sizeof(cmd)) {
+        cmd[len++] = (char)((hex_digit(hex[0]) << 4) | hex_digit(hex[1]));
+        hex += 2;
+    }
+    cmd[len] = '\0';
+
+    char text[256];
+    char name[DEBUG_SYMBOL_LEN];
+    unsigned long long cycle;
+    uint16_t addr;
+
+    if (strcmp(cmd, "syms") == 0) {
+        for (int i = 0; i < dbg->symbol_count; i++) {
+            snprintf(text, sizeof(text), "%04X %s\n", dbg->symbols[i].address, dbg->symbols[i].name);
+            monitor_output(gdb, text);
+        }
+    } else if (sscanf(cmd, "sym %31s", name) == 1) {
+        if (debug_find_symbol(dbg, name, &addr)) {
+            snprintf(text, sizeof(text), "%s = word 0x%04X (gdb address 0x%X)\n", name, addr, addr * 2);
+        } else {
+            snprintf(text, sizeof(text), "No symbol %s\n", name);
+        }
+        monitor_output(gdb, text);
+    } else if (sscanf(cmd, "break %31s", name) == 1) {
+        if (debug_find_symbol(dbg, name, &addr)) {
+            debug_set_breakpoint(dbg, addr);
+            snprintf(text, sizeof(text), "Breakpoint at %s (word 0x%04X)\n", name, addr);
+        } else {
+            snprintf(text, sizeof(text), "No symbol %s\n", name);
+        }
+        monitor_output(gdb, text);
+    } else if (strcmp(cmd, "cycles") == 0) {
+        snprintf(text, sizeof(text), "%llu instructions executed\n", (unsigned long long)sys->cycles);
+        monitor_output(gdb, text);
+    } else if (sscanf(cmd, "seek %llu", &cycle) == 1) {
+        // Fast-forward or rewind to an instruction count
+        if (!replay_seek(rp, sys, cycle)) monitor_output(gdb, "Machine halted before that instruction\n");
+        sys->watch_hit = false;
+    } else {
+        monitor_output(gdb, "Commands: syms, sym <label>, break <label>, cycles, seek <instruction count>\n");
+    }
+    send_packet(gdb, "OK");
+}
+
+// --- PACKETS ---
+
+static void handle_packet(GdbStub *gdb, Debugger *dbg, System *sys, Replay *rp, char *pkt) {
+    char reply[GDB_BUF_SIZE];
+    char *end;
+
+    switch (pkt[0]) {
+        case '?':
+            send_stop(gdb, dbg, sys, sys->running ? STOP_STEP : STOP_HALTED);
+            break;
+
+        case 'g': {
+            size_t len = 0;
+            for (int i = 0; i < GDB_NUM_REGS; i++) {
+                put_hex_le(&reply[len], read_register(sys, i), register_bytes(i));
+                len += register_bytes(i) * 2;
+            }
+            reply[len] = '\0';
+            send_packet(gdb, reply);
+            break;
+        }
+
+        case 'G': {
+            if (strlen(pkt + 1) < GDB_REGS_HEX) {
+                send_packet(gdb, "E01");
+                break;
+            }
+            const char *data = pkt + 1;
+            for (int i = 0; i < GDB_NUM_REGS; i++) {
+                uint32_t value = get_hex_le(data, register_bytes(i));
+                if (value != read_register(sys, i)) write_register(sys, rp, i, value);
+                data += register_bytes(i) * 2;
+            }
+            send_packet(gdb, "OK");
+            break;
+        }
+
+        case 'p': {
+            unsigned long n = strtoul(pkt + 1, NULL, 16);
+            if (n >= GDB_NUM_REGS) {
+                send_packet(gdb, "E01");
+                break;
+            }
+            put_hex_le(reply, read_register(sys, n), register_bytes(n));
+            reply[register_bytes(n) * 2] = '\0';
+            send_packet(gdb, reply);
+            break;
+        }
+
+        case 'P': {
+            unsigned long n = strtoul(pkt + 1, &end, 16);
+            if (n >= GDB_NUM_REGS || *end != '=' || strlen(end + 1) < (size_t)register_bytes(n) * 2) {
+                send_packet(gdb, "E01");
+                break;
+            }
+            write_register(sys, rp, n, get_hex_le(end + 1, register_bytes(n)));
+            send_packet(gdb, "OK");
+            break;
+        }
+
+        case 'm': {
+            unsigned long addr = strtoul(pkt + 1, &end, 16);
+            unsigned long len = (*end == ',') ? strtoul(end + 1, NULL, 16) : 0;
+            if (len > (sizeof(reply) - 1) / 2) len = (sizeof(reply) - 1) / 2;
+            for (unsigned long i = 0; i < len; i++) {
+                uint8_t b = read_byte(sys, addr + i);
+                reply[i * 2] = HEX[b >> 4];
+                reply[i * 2 + 1] = HEX[b & 0xF];
+            }
+            reply[len * 2] = '\0';
+            send_packet(gdb, reply);
+            break;
+        }
+
+        case 'M': {
+            unsigned long addr = strtoul(pkt + 1, &end, 16);
+            unsigned long len = (*end == ',') ? strtoul(end + 1, &end, 16) : 0;
+            if (*end != ':' || strlen(end + 1) < len * 2) {
+                send_packet(gdb, "E01");
+                break;
+            }
+            const char *data = end + 1;
+            for (unsigned long i = 0; i < len; i++) {
+                write_byte(sys, rp, addr + i, (hex_digit(data[i * 2]) << 4) | hex_digit(data[i * 2 + 1]));
+            }
+            send_packet(gdb, "OK");
+            break;
+        }
+
+        case 'c':
+            if (pkt[1]) write_register(sys, rp, 8, strtoul(pkt + 1, NULL, 16));
+            dbg->resuming = true;
+            gdb->running = true; // Reply is sent when the target stops
+            break;
+
+        case 's':
+            if (pkt[1]) write_register(sys, rp, 8, strtoul(pkt + 1, NULL, 16));
+            send_stop(gdb, dbg, sys, debug_step(dbg, sys, rp));
+            break;
+
+        case 'b':
+            if (pkt[1] == 's') {
+                if (sys->cycles == 0) send_packet(gdb, "T05replaylog:begin;");
+                else send_stop(gdb, dbg, sys, debug_reverse_step(dbg, sys, rp));
+            } else if (pkt[1] == 'c') {
+                StopReason reason = debug_reverse_continue(dbg, sys, rp);
+                if (reason == STOP_BREAKPOINT || reason == STOP_WATCHPOINT) send_stop(gdb, dbg, sys, reason);
+                else send_packet(gdb, "T05replaylog:begin;");
+            } else {
+                send_packet(gdb, "");
+            }
+            break;
+
+        case 'Z':
+        case 'z': {
+            int type = pkt[1] - '0';
+            unsigned long addr = strtoul(pkt + 3, &end, 16);
+            unsigned long kind = (*end == ',') ? strtoul(end + 1, NULL, 16) : 2;
+            uint16_t word = (addr / 2) & (MEM_SIZE - 1);
+            uint16_t words = (uint16_t)((addr + kind + 1) / 2 - addr / 2);
+            uint8_t watch = (type == 2) ? PAGE_WATCH_W : (type == 3) ? PAGE_WATCH_R : (PAGE_WATCH_R | PAGE_WATCH_W);
+            bool ok = true;
+
+            if (type == 0 || type == 1) {
+                if (pkt[0] == 'Z') debug_set_breakpoint(dbg, word);
+                else debug_clear_breakpoint(dbg, word);
+            } else if (type >= 2 && type <= 4) {
+                if (pkt[0] == 'Z') ok = debug_add_watch(dbg, sys, word, words, watch);
+                else ok = debug_remove_watch(dbg, sys, word, words, watch);
+            } else {
+                send_packet(gdb, "");
+                break;
+            }
+            send_packet(gdb, ok ? "OK" : "E01");
+            break;
+        }
+
+        case 'q':
+            if (strncmp(pkt, "qSupported", 10) == 0) {
+                snprintf(reply, sizeof(reply), "PacketSize=%x;qXfer:features:read+;swbreak+;ReverseStep+;ReverseContinue+",
+                         GDB_PACKET_SIZE);
+                send_packet(gdb, reply);
+            } else if (strncmp(pkt, "qXfer:features:read:target.xml:", 31) == 0) {
+                // Reply 'm' plus a chunk while more follows, 'l' plus the final chunk
+                unsigned long offset = strtoul(pkt + 31, &end, 16);
+                unsigned long len = (*end == ',') ? strtoul(end + 1, NULL, 16) : 0;
+                size_t total = sizeof(TARGET_XML) - 1;
+                if (offset > total) offset = total;
+                if (len > sizeof(reply) - 2) len = sizeof(reply) - 2;
+                if (len > total - offset) len = total - offset;
+                reply[0] = (offset + len < total) ? 'm' : 'l';
+                memcpy(reply + 1, TARGET_XML + offset, len);
+                reply[len + 1] = '\0';
+                send_packet(gdb, reply);
+            } else if (strncmp(pkt, "qXfer:", 6) == 0) {
+                send_packet(gdb, "E00");
+            } else if (strcmp(pkt, "qAttached") == 0) {
+                send_packet(gdb, "1");
+            } else if (strcmp(pkt, "qC") == 0) {
+                send_packet(gdb, "QC1");
+            } else if (strcmp(pkt, "qfThreadInfo") == 0) {
+                send_packet(gdb, "m1");
+            } else if (strcmp(pkt, "qsThreadInfo") == 0) {
+                send_packet(gdb, "l");
+            } else if (strncmp(pkt, "qRcmd,", 6) == 0) {
+                handle_monitor(gdb, dbg, sys, rp, pkt + 6);
+            } else {
+                send_packet(gdb, "");
+            }
+            break;
+
+        case 'H':
+            send_packet(gdb, "OK");
+            break;
+
+        case 'D':
+            send_packet(gdb, "OK");
+            drop_client(gdb);
+            gdb->attached = false;
+            break;
+
+        case 'k':
+            sys->running = false;
+            drop_client(gdb);
+            gdb->attached = false;
+            break;
+
+        default:
+            send_packet(gdb, ""); // Unsupported
+    }
+}
+
+// Serves every complete packet in the input buffer
+static void process_input(GdbStub *gdb, Debugger *dbg, System *sys, Replay *rp) {
+    size_t pos = 0;
+    while (pos < gdb->in_len && gdb->client_fd >= 0) {
+        char c = gdb->in[pos];
+        if (gdb->discarding) {
+            // Skip the rest of a packet too large for the buffer, then NAK it
+            char *hash = memchr(gdb->in + pos, '#', gdb->in_len - pos);
+            if (hash == NULL) {
+                pos = gdb->in_len;
+            } else if ((size_t)(hash - gdb->in) + 2 >= gdb->in_len) {
+                pos = hash - gdb->in;
+                break; // Checksum still to come
+            } else {
+                pos = (hash - gdb->in) + 3;
+                gdb->discarding = false;
+                send_all(gdb, "-", 1);
+            }
+        } else if (c == 0x03) {
+            // Ctrl-C from GDB
+            pos++;
+            if (gdb->running) {
+                gdb->running = false;
+                send_stop(gdb, dbg, sys, STOP_INTERRUPT);
+            }
+        } else if (c == '$') {
+            char *hash = memchr(gdb->in + pos, '#', gdb->in_len - pos);
+            if (hash == NULL || (size_t)(hash - gdb->in) + 2 >= gdb->in_len) {
+                // Incomplete; a packet filling the whole buffer can never complete
+                if (pos == 0 && gdb->in_len == sizeof(gdb->in)) {
+                    gdb->discarding = true;
+                    pos = hash != NULL ? (size_t)(hash - gdb->in) : gdb->in_len;
+                    continue;
+                }
+                break;
+            }
+
+            uint8_t sum = 0;
+            for (char *p = gdb->in + pos + 1; p < hash; p++) sum += (uint8_t)*p;
+            uint8_t expected = (hex_digit(hash[1]) << 4) | hex_digit(hash[2]);
+            size_t next = (hash - gdb->in) + 3;
+
+            if (sum != expected) {
+                send_all(gdb, "-", 1);
+            } else {
+                send_all(gdb, "+", 1);
+                *hash = '\0';
+                handle_packet(gdb, dbg, sys, rp, gdb->in + pos + 1);
+            }
+            pos = next;
+        } else {
+            pos++; // Acks and line noise
+        }
+    }
+
+    if (gdb->client_fd < 0) pos = gdb->in_len;
+    memmove(gdb->in, gdb->in + pos, gdb->in_len - pos);
+    gdb->in_len -= pos;
+}
+
+// --- PUBLIC API ---
+
+bool gdb_open(GdbStub *gdb, uint16_t port) {
+    memset(gdb, 0, sizeof(*gdb));
+    gdb->listen_fd = -1;
+    gdb->client_fd = -1;
+
+#ifdef _WIN32
+    WSADATA wsa;
+    if (WSAStartup(MAKEWORD(2, 2), &wsa) != 0) return false;
+#endif
+
+    gdb->listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (gdb->listen_fd < 0) {
+        perror("Error creating GDB socket");
+        return false;
+    }
+
+    int reuse = 1;
+    setsockopt(gdb->listen_fd, SOL_SOCKET, SO_REUSEADDR, (const char *)&reuse, sizeof(reuse));
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    if (bind(gdb->listen_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(gdb->listen_fd, 1) < 0) {
+        perror("Error binding GDB socket");
+        CLOSE_SOCKET(gdb->listen_fd);
+        gdb->listen_fd = -1;
+        return false;
+    }
+    set_nonblocking(gdb->listen_fd);
+
+    gdb->attached = true;
+    printf("Waiting for GDB on 127.0.0.1:%u\n", port);
+    return true;
+}
+
+void gdb_close(GdbStub *gdb) {
+    if (gdb->client_fd >= 0) drop_client(gdb);
+    if (gdb->listen_fd >= 0) CLOSE_SOCKET(gdb->listen_fd);
+    gdb->listen_fd = -1;
+    gdb->attached = false;
+#ifdef _WIN32
+    WSACleanup();
+#endif
+}
+
+void gdb_poll(GdbStub *gdb, Debugger *dbg, System *sys, Replay *rp, uint32_t max_steps) {
+    if (!gdb->attached) return;
+
+    if (gdb->client_fd < 0) {
+        intptr_t fd = accept(gdb->listen_fd, NULL, NULL);
+        if (fd < 0) return; // Target stays stopped until GDB connects
+        set_nonblocking(fd);
+#ifdef SO_NOSIGPIPE
+        int on = 1; // No MSG_NOSIGNAL on macOS/BSD
+        setsockopt((int)fd, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+#endif
+        gdb->client_fd = fd;
+        gdb->in_len = 0;
+        gdb->discarding = false;
+        printf("GDB connected\n");
+    }
+
+    bool closed = false;
+    while (gdb->in_len < sizeof(gdb->in)) {
+        long n = recv(gdb->client_fd, gdb->in + gdb->in_len, sizeof(gdb->in) - gdb->in_len, 0);
+        if (n > 0) {
+            gdb->in_len += n;
+        } else if (n < 0 && would_block()) {
+            break; // Nothing more to read right now
+        } else {
+            closed = true;
+            break;
+        }
+    }
+    // Packets that arrived with the close still count (GDB sends 'k' and hangs up)
+    process_input(gdb, dbg, sys, rp);
+
+    if (closed && gdb->client_fd >= 0) {
+        // GDB went away: treat it as a detach
+        drop_client(gdb);
+        gdb->attached = false;
+        return;
+    }
+    if (!gdb->attached) return;
+
+    if (gdb->running) {
+        StopReason reason = debug_run(dbg, sys, rp, max_steps);
+        if (reason != STOP_NONE) {
+            gdb->running = false;
+            send_stop(gdb, dbg, sys, reason);
+        }
+    }
+}
@@ -0,0 +1,40 @@
+#ifndef GDBSTUB_H
+#define GDBSTUB_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "cpu.h"
+#include "debug.h"
+#include "replay.h"
+
+// Configuration
+#define GDB_BUF_SIZE 4096
+#define GDB_PACKET_SIZE (GDB_BUF_SIZE - 16) // Advertised to GDB: a full packet plus '$', '#xx' and acks fits the buffer
+
+// GDB remote serial protocol server on 127.0.0.1.
+// Register layout for 'g'/'G'/'p'/'P' (little-endian):
+//   0-7 = R0-R7 (16-bit), 8 = PC as a byte address (32-bit), 9 = flags (16-bit, bit 0 Z, 1 N, 2 V, 3 C)
+// described to GDB by a target.xml served over qXfer. Register and memory writes
+// are recorded as replay inputs, so reverse execution and seeks keep them.
+// GDB addresses are byte addresses: word N lives at bytes 2N (low) and 2N+1 (high),
+// the same layout as the program binary on disk.
+typedef struct {
+    intptr_t listen_fd;
+    intptr_t client_fd;
+    bool running;     // Target is executing a 'c' until the next stop
+    bool attached;    // False once GDB detaches or kills the target
+    char in[GDB_BUF_SIZE];
+    size_t in_len;
+    bool discarding;  // Dropping an oversize packet up to its checksum
+} GdbStub;
+
+// Function Prototypes
+bool gdb_open(GdbStub *gdb, uint16_t port);
+void gdb_close(GdbStub *gdb);
+
+// Non-blocking: accepts a connection, serves pending packets and, while GDB has
+// the target running, executes up to max_steps instructions.
+void gdb_poll(GdbStub *gdb, Debugger *dbg, System *sys, Replay *rp, uint32_t max_steps);
+
+#endif
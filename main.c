@@ -2,13 +2,28 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include "cpu.h"
+#include "replay.h"
+#include "debug.h"
+#include "gdbstub.h"
+#include "memsim.h"
+#include "smp.h"
+#include "capture.h"
+#include "spmd.h"
 
 // --- VM SCREEN CONFIGURATION ---
 #define SCREEN_WIDTH 64
 #define SCREEN_HEIGHT 64
 #define VRAM_START 0xE000 
 
+// --- REPLAY CONFIGURATION ---
+#define CHECKPOINT_INTERVAL 100000 // Instructions between memory checkpoints
+
+// --- MULTI-HART CONFIGURATION ---
+#define HART_QUANTUM 1000 // Instructions a threaded hart runs between stop checks
+
 // --- SDL CONFIGURATION ---
 SDL_Window *window = NULL;
 SDL_Renderer *renderer = NULL;
@@ -16,7 +31,17 @@ SDL_Texture *texture = NULL;
 
 uint16_t pixel_buffer[SCREEN_WIDTH * SCREEN_HEIGHT];
 
+// --- SINGLE-CORE MEMORY ---
+uint16_t ram[MEM_SIZE];
+
+// --- OUTPUT CONFIGURATION ---
+bool headless = false;     // No window: run as fast as possible, e.g. for batch capture
+Capture *capture = NULL;   // Optional frame sink for VRAM
+uint64_t frame_limit = 0;  // Stop after this many frames, 0 = no limit
+
 void init_graphics() {
+    if (headless) return;
+
     // SDL3 Init returns true on success, false on failure (unlike 0 in SDL2)
     if (!SDL_Init(SDL_INIT_VIDEO)) {
         SDL_Log("SDL_Init failed: %s", SDL_GetError());
@@ -41,12 +66,224 @@ void init_graphics() {
                                 SCREEN_WIDTH, SCREEN_HEIGHT);
 }
 
+void render_screen(const uint16_t *vram) {
+    if (headless) return;
+    for (int i = 0; i < (SCREEN_WIDTH * SCREEN_HEIGHT); i++) {
+        pixel_buffer[i] = vram[i];
+    }
+    SDL_UpdateTexture(texture, NULL, pixel_buffer, SCREEN_WIDTH * sizeof(uint16_t));
+    SDL_RenderClear(renderer);
+    SDL_RenderTexture(renderer, texture, NULL, NULL);
+    SDL_RenderPresent(renderer);
+}
+
+// Returns true once the user closed the window
+bool poll_quit() {
+    bool quit = false;
+    if (headless) return quit;
+    SDL_Event event;
+    while (SDL_PollEvent(&event)) {
+        if (event.type == SDL_EVENT_QUIT) quit = true;
+    }
+    return quit;
+}
+
+// Shows (and captures) one frame. Returns false once the frame limit is reached.
+bool present_frame(const uint16_t *vram, uint64_t *frames) {
+    if (capture != NULL) capture_frame(capture, vram);
+    render_screen(vram);
+
+    // 60 FPS
+    if (!headless) SDL_Delay(16);
+    return frame_limit == 0 || ++*frames < frame_limit;
+}
+
+void shutdown_graphics() {
+    if (headless) return;
+    SDL_DestroyTexture(texture);
+    SDL_DestroyRenderer(renderer);
+    SDL_DestroyWindow(window);
+    SDL_Quit();
+}
+
+// Runs the loaded program on several harts sharing one memory
+int run_multicore(const System *loaded, int hart_count, bool lockstep) {
+    SmpMachine smp;
+    // Lockstep switches harts after every instruction so interleavings are reproducible
+    if (!smp_init(&smp, hart_count, lockstep ? 1 : HART_QUANTUM, lockstep)) {
+        fprintf(stderr, "Error: between 1 and %d harts are supported\n", SMP_MAX_HARTS);
+        return 1;
+    }
+    smp_load(&smp, loaded->memory, MEM_SIZE);
+    if (!lockstep && !smp_start(&smp)) {
+        smp_free(&smp);
+        return 1;
+    }
+    printf("Running %d harts (%s).\n", hart_count, lockstep ? "round-robin" : "threaded");
+
+    uint64_t frames = 0;
+    uint16_t vram[SCREEN_WIDTH * SCREEN_HEIGHT];
+    while (!smp_finished(&smp)) {
+        if (poll_quit()) smp_stop(&smp);
+
+        // Threaded harts run on their own; lockstep gives every hart 100 instructions per frame
+        if (lockstep) smp_run_round_robin(&smp, 100);
+
+        // Harts may be storing to VRAM right now, so read it the way they write it
+        for (int i = 0; i < (SCREEN_WIDTH * SCREEN_HEIGHT); i++) {
+            vram[i] = __atomic_load_n(&smp.memory[VRAM_START + i], __ATOMIC_RELAXED);
+        }
+        if (!present_frame(vram, &frames)) smp_stop(&smp);
+        // Threaded harts don't wait for frames, so headless still samples the screen at 60 FPS
+        if (headless && !lockstep) SDL_Delay(16);
+    }
+
+    smp_free(&smp);
+    return 0;
+}
+
+// Runs the loaded program once per line of inputs ("-" = stdin), all lanes in lockstep.
+// Each line holds up to seven hex words, the starting R1-R7 of one lane.
+int run_spmd(const System *loaded, const char *path) {
+    FILE *f = strcmp(path, "-") == 0 ? stdin : fopen(path, "r");
+    if (f == NULL) {
+        perror(path);
+        return 1;
+    }
+
+    uint16_t inputs[SPMD_MAX_LANES][7] = {{0}};
+    int lanes = 0;
+    char line[256];
+    while (fgets(line, sizeof(line), f) != NULL) {
+        const char *p = line;
+        unsigned int value;
+        int used, n = 0;
+        uint16_t regs[7] = {0};
+        while (n < 7 && sscanf(p, "%x%n", &value, &used) == 1) {
+            regs[n++] = (uint16_t)value;
+            p += used;
+        }
+        if (n == 0) continue; // Blank line
+        if (lanes == SPMD_MAX_LANES) {
+            fprintf(stderr, "Error: at most %d input lines (one per lane)\n", SPMD_MAX_LANES);
+            if (f != stdin) fclose(f);
+            return 1;
+        }
+        memcpy(inputs[lanes++], regs, sizeof(regs));
+    }
+    if (f != stdin) fclose(f);
+    if (lanes == 0) {
+        fprintf(stderr, "Error: no inputs in %s\n", path);
+        return 1;
+    }
+
+    SpmdMachine spmd;
+    if (!spmd_init(&spmd, lanes)) {
+        fprintf(stderr, "Error allocating SPMD lanes\n");
+        return 1;
+    }
+    spmd_load(&spmd, loaded->memory, MEM_SIZE);
+    for (int l = 0; l < lanes; l++) {
+        for (int r = 1; r < 8; r++) spmd.registers[r][l] = inputs[l][r - 1];
+    }
+    spmd_run(&spmd, UINT64_MAX);
+
+    printf("Lane   R0   R1   R2   R3   R4   R5   R6   R7    PC  Instructions\n");
+    for (int l = 0; l < lanes; l++) {
+        printf("%4d ", l);
+        for (int r = 0; r < 8; r++) printf(" %04X", spmd.registers[r][l]);
+        printf("  %04X  %12llu\n", spmd.pc[l], (unsigned long long)spmd.cycles[l]);
+    }
+    printf("%llu issues, %.1f lanes active per issue\n", (unsigned long long)spmd.issues,
+           spmd.issues ? (double)spmd.lane_instructions / spmd.issues : 0.0);
+
+    spmd_free(&spmd);
+    return 0;
+}
+
 
 int main(int argc, char* argv[]) {
+    const char *record_path = NULL;
+    const char *replay_path = NULL;
+    uint16_t gdb_port = 0;
+    int hart_count = 0;
+    bool lockstep = false;
+    CaptureConfig capture_cfg;
+    bool use_capture = false;
+    bool use_memsim = false;
+    const char *spmd_path = NULL;
+    CacheConfig icache_cfg, dcache_cfg, tlb_cfg;
+    memsim_default_config(&icache_cfg, &dcache_cfg, &tlb_cfg);
+    const char *range_specs[MEMSIM_MAX_RANGES];
+    int range_count = 0;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--record") == 0 && i + 1 < argc) {
+            record_path = argv[++i];
+        } else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc) {
+            replay_path = argv[++i];
+        } else if (strcmp(argv[i], "--gdb") == 0 && i + 1 < argc) {
+            gdb_port = (uint16_t)atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--harts") == 0 && i + 1 < argc) {
+            char *end;
+            long n = strtol(argv[++i], &end, 10);
+            if (*end != '\0' || n < 1 || n > SMP_MAX_HARTS) {
+                fprintf(stderr, "Error: --harts takes a number from 1 to %d\n", SMP_MAX_HARTS);
+                return 1;
+            }
+            hart_count = (int)n;
+        } else if (strcmp(argv[i], "--spmd") == 0 && i + 1 < argc) {
+            spmd_path = argv[++i];
+        } else if (strcmp(argv[i], "--lockstep") == 0) {
+            lockstep = true;
+        } else if (strcmp(argv[i], "--headless") == 0) {
+            headless = true;
+        } else if (strcmp(argv[i], "--capture") == 0 && i + 1 < argc && capture_parse_spec(argv[i + 1], &capture_cfg)) {
+            use_capture = true;
+            i++;
+        } else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+            frame_limit = strtoull(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--memsim") == 0) {
+            use_memsim = true;
+        } else if (strcmp(argv[i], "--icache") == 0 && i + 1 < argc && memsim_parse_config(argv[i + 1], &icache_cfg)) {
+            use_memsim = true;
+            i++;
+        } else if (strcmp(argv[i], "--dcache") == 0 && i + 1 < argc && memsim_parse_config(argv[i + 1], &dcache_cfg)) {
+            use_memsim = true;
+            i++;
+        } else if (strcmp(argv[i], "--tlb") == 0 && i + 1 < argc && memsim_parse_config(argv[i + 1], &tlb_cfg)) {
+            use_memsim = true;
+            i++;
+        } else if (strcmp(argv[i], "--memsim-range") == 0 && i + 1 < argc && range_count < MEMSIM_MAX_RANGES) {
+            use_memsim = true;
+            range_specs[range_count++] = argv[++i];
+        } else {
+            fprintf(stderr, "Usage: %s [--record <file>] [--replay <file>] [--gdb <port>] [--harts <n> [--lockstep]] [--spmd <inputs>]\n", argv[0]);
+            fprintf(stderr, "       [--headless] [--capture <ppm|png|y4m:path[:scale]>] [--frames <n>]\n");
+            fprintf(stderr, "       [--memsim] [--icache|--dcache|--tlb <line,sets,ways,hit,miss>] [--memsim-range <name:start-end>]\n");
+            return 1;
+        }
+    }
+
+    // Record/replay, the debugger and the cache model work on a single CPU only
+    if (hart_count > 0 && (record_path || replay_path || gdb_port || use_memsim)) {
+        fprintf(stderr, "Error: --harts cannot be combined with --record, --replay, --gdb or the cache simulator\n");
+        return 1;
+    }
+    if (lockstep && hart_count == 0) {
+        fprintf(stderr, "Error: --lockstep needs --harts\n");
+        return 1;
+    }
+    // An SPMD sweep is a batch run with no screen
+    if (spmd_path != NULL && (hart_count > 0 || record_path || replay_path || gdb_port || use_memsim || use_capture)) {
+        fprintf(stderr, "Error: --spmd cannot be combined with --harts, --record, --replay, --gdb, --capture or the cache simulator\n");
+        return 1;
+    }
+    if (spmd_path != NULL) headless = true;
+
     init_graphics();
     
     System my_machine;
-    init_system(&my_machine);
+    init_system(&my_machine, ram);
 
     FILE *program_file = fopen("./output/output.bin", "rb");
     if (program_file == NULL) {
@@ -66,35 +303,98 @@ int main(int argc, char* argv[]) {
         fprintf(stderr, "Warning: Program file size is not a multiple of 2 bytes. Some data might be truncated.\n");
     }
 
+    // Frames are encoded and written on a background thread. Opened before any
+    // more output so that a Y4M stream on stdout sends the messages to stderr
+    Capture capture_sink;
+    if (use_capture) {
+        // Without a window nobody watches in real time, so no frame may be dropped
+        capture_cfg.lossless = headless;
+        if (!capture_open(&capture_sink, &capture_cfg, SCREEN_WIDTH, SCREEN_HEIGHT)) return 1;
+        capture = &capture_sink;
+    }
+
     printf("Loaded %zu words into memory.\n", words_read);
 
+    if (spmd_path != NULL) return run_spmd(&my_machine, spmd_path);
 
+    if (hart_count > 0) {
+        int status = run_multicore(&my_machine, hart_count, lockstep);
+        if (capture != NULL) capture_close(capture);
+        shutdown_graphics();
+        return status;
+    }
 
-    while (my_machine.running) {
-        SDL_Event event;
-        while (SDL_PollEvent(&event)) {
-            if (event.type == SDL_EVENT_QUIT) my_machine.running = false;
+    // Optional cache/TLB model on the fetch and LD/ST paths
+    MemSim memsim;
+    if (use_memsim) {
+        if (!memsim_init(&memsim, &icache_cfg, &dcache_cfg, &tlb_cfg)) {
+            fprintf(stderr, "Error: invalid cache configuration\n");
+            return 1;
+        }
+        for (int i = 0; i < range_count; i++) {
+            if (!memsim_parse_region(&memsim, range_specs[i])) fprintf(stderr, "Ignoring range %s\n", range_specs[i]);
         }
+        my_machine.memsim = &memsim;
+    }
 
-        for (int i= 0; i < 100; i++)
-        if (my_machine.running) step_cpu(&my_machine);
+    // Checkpoints stay on for every run; inputs are logged so the run can be replayed
+    Replay replay;
+    if (!replay_init(&replay, &my_machine, CHECKPOINT_INTERVAL)) {
+        fprintf(stderr, "Error allocating replay checkpoints\n");
+        return 1;
+    }
+    if (replay_path != NULL && !replay_load_inputs(&replay, replay_path)) return 1;
+
+    // The debugger only runs the machine while GDB is attached; the plain loop stays untouched
+    Debugger debugger;
+    GdbStub gdb;
+    bool debugging = (gdb_port != 0);
+    if (debugging) {
+        debug_init(&debugger);
+        if (!debug_load_symbols(&debugger, "./output/output.sym")) printf("No symbol file, labels unavailable.\n");
+        if (!gdb_open(&gdb, gdb_port)) return 1;
+    }
+
+    uint64_t frames = 0;
+    while (my_machine.running || debugging) {
+        if (poll_quit()) {
+            debugging = false;
+            // While replaying, the recorded inputs drive the machine
+            if (replay_path != NULL) my_machine.running = false;
+            else replay_record_input(&replay, &my_machine, INPUT_QUIT, 0, 0);
+        }
+
+        if (debugging) {
+            gdb_poll(&gdb, &debugger, &my_machine, &replay, 100);
+            debugging = gdb.attached;
+        } else {
+            for (int i= 0; i < 100; i++)
+            if (my_machine.running) replay_step(&replay, &my_machine);
+        }
 
         //Render Screen
-        for (int i = 0; i < (SCREEN_WIDTH * SCREEN_HEIGHT); i++) {
-            pixel_buffer[i] = my_machine.memory[VRAM_START + i];
+        // The frame limit is an external stop like the window closing, so it goes in the log too
+        if (!present_frame(&my_machine.memory[VRAM_START], &frames)) {
+            debugging = false;
+            if (replay_path != NULL || !my_machine.running) my_machine.running = false;
+            else replay_record_input(&replay, &my_machine, INPUT_QUIT, 0, 0);
         }
-        SDL_UpdateTexture(texture, NULL, pixel_buffer, SCREEN_WIDTH * sizeof(uint16_t));
-        SDL_RenderClear(renderer);
-        SDL_RenderTexture(renderer, texture, NULL, NULL);
-        SDL_RenderPresent(renderer);
-        
-        // 60 FPS
-        SDL_Delay(16); 
     }
 
-    SDL_DestroyTexture(texture);
-    SDL_DestroyRenderer(renderer);
-    SDL_DestroyWindow(window);
-    SDL_Quit();
+    if (record_path != NULL && !replay_save_inputs(&replay, record_path)) {
+        fprintf(stderr, "Error writing replay file %s\n", record_path);
+    }
+    replay_free(&replay);
+    if (use_memsim) {
+        memsim_report(&memsim, stdout);
+        memsim_free(&memsim);
+    }
+    if (gdb_port != 0) {
+        gdb_close(&gdb);
+        debug_free(&debugger);
+    }
+    if (capture != NULL) capture_close(capture);
+
+    shutdown_graphics();
     return 0;
 }
\ No newline at end of file
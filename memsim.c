@@ -0,0 +1,218 @@
+#include "memsim.h"
+#include <stdlib.h>
+#include <string.h>
+#include "cpu.h"
+
+#define MEMSIM_TOP_INSTRUCTIONS 10
+
+// --- CACHE MODEL ---
+
+static bool is_power_of_two(uint32_t n) {
+    return n != 0 && (n & (n - 1)) == 0;
+}
+
+static bool cache_init(Cache *c, const CacheConfig *cfg) {
+    memset(c, 0, sizeof(*c));
+    if (!is_power_of_two(cfg->line_words) || !is_power_of_two(cfg->sets) || cfg->ways == 0) return false;
+
+    c->cfg = *cfg;
+    while ((1u << c->line_shift) < cfg->line_words) c->line_shift++;
+
+    size_t slots = (size_t)cfg->sets * cfg->ways;
+    c->tags = malloc(slots * sizeof(uint32_t));
+    c->stamps = calloc(slots, sizeof(uint64_t));
+    if (c->tags == NULL || c->stamps == NULL) return false;
+    for (size_t i = 0; i < slots; i++) c->tags[i] = UINT32_MAX;
+    return true;
+}
+
+static void cache_free(Cache *c) {
+    free(c->tags);
+    free(c->stamps);
+    c->tags = NULL;
+    c->stamps = NULL;
+}
+
+// Returns true on a hit; on a miss the LRU way of the set is refilled
+static bool cache_access(Cache *c, uint16_t addr) {
+    uint32_t line = addr >> c->line_shift;
+    uint32_t set = line & (c->cfg.sets - 1);
+    uint32_t *tags = &c->tags[set * c->cfg.ways];
+    uint64_t *stamps = &c->stamps[set * c->cfg.ways];
+    uint64_t now = ++c->clock;
+
+    int victim = 0;
+    for (int w = 0; w < c->cfg.ways; w++) {
+        if (tags[w] == line) {
+            stamps[w] = now;
+            c->hits++;
+            return true;
+        }
+        if (stamps[w] < stamps[victim]) victim = w; // Empty ways have stamp 0
+    }
+
+    tags[victim] = line;
+    stamps[victim] = now;
+    c->misses++;
+    return false;
+}
+
+// --- CONFIGURATION ---
+
+void memsim_default_config(CacheConfig *icache, CacheConfig *dcache, CacheConfig *tlb) {
+    // 512-word, 2-way caches with 8-word lines
+    CacheConfig cache = {8, 32, 2, 1, 20};
+    // 16-entry, 4-way TLB over 256-word pages
+    CacheConfig pages = {256, 4, 4, 0, 10};
+    *icache = cache;
+    *dcache = cache;
+    *tlb = pages;
+}
+
+bool memsim_parse_config(const char *spec, CacheConfig *cfg) {
+    unsigned int line, sets, ways, hit, miss;
+    if (sscanf(spec, "%u,%u,%u,%u,%u", &line, &sets, &ways, &hit, &miss) != 5) return false;
+    if (line > 0x8000 || sets > 0x8000 || ways > 0xFFFF || hit > 0xFFFF || miss > 0xFFFF) return false;
+    if (!is_power_of_two(line) || !is_power_of_two(sets) || ways == 0) return false;
+
+    cfg->line_words = line;
+    cfg->sets = sets;
+    cfg->ways = ways;
+    cfg->hit_latency = hit;
+    cfg->miss_latency = miss;
+    return true;
+}
+
+bool memsim_init(MemSim *ms, const CacheConfig *icache, const CacheConfig *dcache, const CacheConfig *tlb) {
+    memset(ms, 0, sizeof(*ms));
+    bool ok = cache_init(&ms->icache, icache);
+    ok = cache_init(&ms->dcache, dcache) && ok;
+    ok = cache_init(&ms->tlb, tlb) && ok;
+    ms->pc_accesses = calloc(MEM_SIZE, sizeof(uint32_t));
+    ms->pc_misses = calloc(MEM_SIZE, sizeof(uint32_t));
+    if (!ok || ms->pc_accesses == NULL || ms->pc_misses == NULL) {
+        memsim_free(ms);
+        return false;
+    }
+
+    // The memory map from the README
+    memsim_add_region(ms, "Code", 0x0000, 0x7FFF);
+    memsim_add_region(ms, "Heap", 0x8000, 0xDFFF);
+    memsim_add_region(ms, "VRAM", 0xE000, 0xEFFF);
+    memsim_add_region(ms, "Stack", 0xF000, 0xFFFF);
+    return true;
+}
+
+void memsim_free(MemSim *ms) {
+    cache_free(&ms->icache);
+    cache_free(&ms->dcache);
+    cache_free(&ms->tlb);
+    free(ms->pc_accesses);
+    free(ms->pc_misses);
+    ms->pc_accesses = NULL;
+    ms->pc_misses = NULL;
+}
+
+bool memsim_add_region(MemSim *ms, const char *name, uint16_t start, uint16_t end) {
+    if (ms->region_count == MEMSIM_MAX_REGIONS || end < start) return false;
+
+    MemRegion *r = &ms->regions[ms->region_count++];
+    memset(r, 0, sizeof(*r));
+    snprintf(r->name, sizeof(r->name), "%s", name);
+    r->start = start;
+    r->end = end;
+    return true;
+}
+
+bool memsim_parse_region(MemSim *ms, const char *spec) {
+    char name[16];
+    unsigned int start, end;
+    if (sscanf(spec, "%15[^:]:%x-%x", name, &start, &end) != 3) return false;
+    if (start > 0xFFFF || end > 0xFFFF) return false;
+    return memsim_add_region(ms, name, start, end);
+}
+
+// --- SIMULATION ---
+
+void memsim_access(MemSim *ms, uint16_t addr, MemAccess kind, uint16_t pc) {
+    Cache *cache = (kind == MEM_FETCH) ? &ms->icache : &ms->dcache;
+
+    bool tlb_hit = cache_access(&ms->tlb, addr);
+    bool hit = cache_access(cache, addr);
+    uint32_t latency = ms->tlb.cfg.hit_latency + cache->cfg.hit_latency;
+    if (!tlb_hit) latency += ms->tlb.cfg.miss_latency;
+    if (!hit) latency += cache->cfg.miss_latency;
+    ms->latency += latency;
+
+    ms->pc_accesses[pc]++;
+    if (!hit) ms->pc_misses[pc]++;
+
+    // Ranges may overlap (e.g. a struct inside the heap), so every match is counted
+    for (int i = 0; i < ms->region_count; i++) {
+        MemRegion *r = &ms->regions[i];
+        if (addr >= r->start && addr <= r->end) {
+            r->accesses++;
+            r->misses += !hit;
+            r->tlb_misses += !tlb_hit;
+            r->latency += latency;
+        }
+    }
+}
+
+// --- REPORT ---
+
+static double percent(uint64_t part, uint64_t total) {
+    return total ? 100.0 * part / total : 0.0;
+}
+
+static void report_cache(FILE *out, const char *name, const Cache *c) {
+    uint64_t total = c->hits + c->misses;
+    fprintf(out, "%-7s %5u words x %4u sets x %2u ways  %10llu accesses  %10llu misses  (%5.2f%% miss)\n",
+            name, c->cfg.line_words, c->cfg.sets, c->cfg.ways,
+            (unsigned long long)total, (unsigned long long)c->misses, percent(c->misses, total));
+}
+
+static const MemSim *sort_ms;
+
+static int by_misses(const void *a, const void *b) {
+    uint16_t pa = *(const uint16_t *)a;
+    uint16_t pb = *(const uint16_t *)b;
+    if (sort_ms->pc_misses[pa] != sort_ms->pc_misses[pb]) return sort_ms->pc_misses[pa] < sort_ms->pc_misses[pb] ? 1 : -1;
+    return (int)pa - (int)pb;
+}
+
+void memsim_report(const MemSim *ms, FILE *out) {
+    fprintf(out, "\n--- MEMORY HIERARCHY REPORT ---\n");
+    report_cache(out, "I-cache", &ms->icache);
+    report_cache(out, "D-cache", &ms->dcache);
+    report_cache(out, "TLB", &ms->tlb);
+    fprintf(out, "Modelled memory cycles: %llu\n\n", (unsigned long long)ms->latency);
+
+    fprintf(out, "%-15s %-11s %10s %10s %7s %10s %9s\n",
+            "Region", "Range", "Accesses", "Misses", "Miss%", "TLB miss", "Avg cyc");
+    for (int i = 0; i < ms->region_count; i++) {
+        const MemRegion *r = &ms->regions[i];
+        fprintf(out, "%-15s %04X-%04X  %10llu %10llu %6.2f%% %10llu %9.2f\n",
+                r->name, r->start, r->end,
+                (unsigned long long)r->accesses, (unsigned long long)r->misses, percent(r->misses, r->accesses),
+                (unsigned long long)r->tlb_misses, r->accesses ? (double)r->latency / r->accesses : 0.0);
+    }
+
+    // Instructions with the most cache misses (fetch + data)
+    uint16_t *pcs = malloc(MEM_SIZE * sizeof(uint16_t));
+    if (pcs == NULL) return;
+    int count = 0;
+    for (int pc = 0; pc < MEM_SIZE; pc++) {
+        if (ms->pc_misses[pc]) pcs[count++] = pc;
+    }
+    sort_ms = ms;
+    qsort(pcs, count, sizeof(uint16_t), by_misses);
+
+    fprintf(out, "\n%-6s %10s %10s %7s\n", "PC", "Accesses", "Misses", "Miss%");
+    for (int i = 0; i < count && i < MEMSIM_TOP_INSTRUCTIONS; i++) {
+        uint16_t pc = pcs[i];
+        fprintf(out, "%04X   %10u %10u %6.2f%%\n", pc, ms->pc_accesses[pc], ms->pc_misses[pc],
+                percent(ms->pc_misses[pc], ms->pc_accesses[pc]));
+    }
+    free(pcs);
+}
@@ -0,0 +1,74 @@
+#ifndef MEMSIM_H
+#define MEMSIM_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+// Configuration
+#define MEMSIM_BUILTIN_REGIONS 4 // Code, Heap, VRAM, Stack
+#define MEMSIM_MAX_RANGES 16     // User ranges from --memsim-range
+#define MEMSIM_MAX_REGIONS (MEMSIM_BUILTIN_REGIONS + MEMSIM_MAX_RANGES)
+
+typedef enum {
+    MEM_FETCH, // Instruction fetch (I-cache)
+    MEM_READ,  // LD, pop, return (D-cache)
+    MEM_WRITE, // ST, push, call (D-cache, write-allocate)
+} MemAccess;
+
+// Set-associative, LRU. A TLB is the same structure with a page as its "line".
+typedef struct {
+    uint16_t line_words;   // Power of two
+    uint16_t sets;         // Power of two
+    uint16_t ways;
+    uint16_t hit_latency;  // Cycles
+    uint16_t miss_latency; // Cycles added on a miss
+} CacheConfig;
+
+typedef struct {
+    CacheConfig cfg;
+    int line_shift;
+    uint32_t *tags;   // sets * ways, UINT32_MAX = invalid
+    uint64_t *stamps; // Last use, for LRU
+    uint64_t clock;
+    uint64_t hits;
+    uint64_t misses;
+} Cache;
+
+typedef struct {
+    char name[16];
+    uint16_t start; // Inclusive
+    uint16_t end;   // Inclusive
+    uint64_t accesses;
+    uint64_t misses;  // Cache misses (TLB misses are counted separately)
+    uint64_t tlb_misses;
+    uint64_t latency; // Modelled cycles spent on accesses in this range
+} MemRegion;
+
+typedef struct MemSim {
+    Cache icache;
+    Cache dcache;
+    Cache tlb;
+
+    MemRegion regions[MEMSIM_MAX_REGIONS];
+    int region_count;
+
+    // Per instruction address: fetch plus the data access it made
+    uint32_t *pc_accesses;
+    uint32_t *pc_misses;
+    uint64_t latency;
+} MemSim;
+
+// Function Prototypes
+void memsim_default_config(CacheConfig *icache, CacheConfig *dcache, CacheConfig *tlb);
+bool memsim_parse_config(const char *spec, CacheConfig *cfg); // "line,sets,ways,hit,miss"
+bool memsim_init(MemSim *ms, const CacheConfig *icache, const CacheConfig *dcache, const CacheConfig *tlb);
+void memsim_free(MemSim *ms);
+
+bool memsim_add_region(MemSim *ms, const char *name, uint16_t start, uint16_t end);
+bool memsim_parse_region(MemSim *ms, const char *spec); // "name:start-end" in hex
+
+void memsim_access(MemSim *ms, uint16_t addr, MemAccess kind, uint16_t pc);
+void memsim_report(const MemSim *ms, FILE *out);
+
+#endif
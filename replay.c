@@ -0,0 +1,453 @@
+#include "replay.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define REPLAY_MAGIC 0x32524D56 // "VMR2": inputs carry an address
+
+// --- PAGE ENCODING ---
+
+// A page is a list of packets. A header word with the top bit set is a run:
+// the next word repeated (header & 0x7FFF) times. Otherwise the header counts
+// literal words that follow. Code, zeroed heap and filled VRAM shrink a lot.
+#define RLE_RUN 0x8000
+#define RLE_MIN_RUN 3 // Shorter repeats stay literal
+#define RLE_MAX_WORDS (REPLAY_PAGE_WORDS + 1) // Worst case: one literal packet
+
+static uint16_t rle_encode(const uint16_t *page, uint16_t *out) {
+    uint16_t len = 0;
+    int i = 0;
+    while (i < REPLAY_PAGE_WORDS) {
+        int run = 1;
+        while (i + run < REPLAY_PAGE_WORDS && page[i + run] == page[i]) run++;
+        if (run >= RLE_MIN_RUN) {
+            out[len++] = RLE_RUN | run;
+            out[len++] = page[i];
+            i += run;
+            continue;
+        }
+
+        // Literals up to the next worthwhile run
+        int start = i;
+        while (i < REPLAY_PAGE_WORDS) {
+            if (i + RLE_MIN_RUN <= REPLAY_PAGE_WORDS && page[i] == page[i + 1] && page[i] == page[i + 2]) break;
+            i++;
+        }
+        out[len++] = i - start;
+        memcpy(&out[len], &page[start], (i - start) * sizeof(uint16_t));
+        len += i - start;
+    }
+    return len;
+}
+
+static void rle_decode(const uint16_t *in, uint16_t *page) {
+    int i = 0;
+    while (i < REPLAY_PAGE_WORDS) {
+        uint16_t header = *in++;
+        int n = header & ~RLE_RUN;
+        if (header & RLE_RUN) {
+            uint16_t value = *in++;
+            for (int k = 0; k < n; k++) page[i++] = value;
+        } else {
+            memcpy(&page[i], in, n * sizeof(uint16_t));
+            in += n;
+            i += n;
+        }
+    }
+}
+
+// --- PAGE POOL ---
+
+// Returns a free page index, or 0 if the pool could not grow
+static uint32_t pool_alloc(Replay *rp) {
+    if (rp->free_count > 0) return rp->free_pages[--rp->free_count];
+
+    if (rp->pool_count == rp->pool_cap) {
+        uint32_t new_cap = rp->pool_cap * 2;
+        uint16_t **pool = realloc(rp->pool, new_cap * sizeof(*rp->pool));
+        if (pool == NULL) return 0;
+        rp->pool = pool;
+        uint16_t *pool_len = realloc(rp->pool_len, new_cap * sizeof(uint16_t));
+        if (pool_len == NULL) return 0;
+        rp->pool_len = pool_len;
+        uint32_t *refs = realloc(rp->refs, new_cap * sizeof(uint32_t));
+        if (refs == NULL) return 0;
+        rp->refs = refs;
+        uint32_t *free_pages = realloc(rp->free_pages, new_cap * sizeof(uint32_t));
+        if (free_pages == NULL) return 0;
+        rp->free_pages = free_pages;
+        rp->pool_cap = new_cap;
+    }
+    rp->refs[rp->pool_count] = 0;
+    rp->pool[rp->pool_count] = NULL;
+    return rp->pool_count++;
+}
+
+static void page_release(Replay *rp, uint32_t idx) {
+    if (idx == 0) return; // The zero page is never freed
+    if (--rp->refs[idx] == 0) {
+        free(rp->pool[idx]);
+        rp->pool[idx] = NULL;
+        rp->free_pages[rp->free_count++] = idx;
+    }
+}
+
+// Stores an encoded page, returns its index or 0 when out of memory
+static uint32_t pool_store(Replay *rp, const uint16_t *encoded, uint16_t len) {
+    uint32_t idx = pool_alloc(rp);
+    if (idx == 0) return 0;
+    rp->pool[idx] = malloc(len * sizeof(uint16_t));
+    if (rp->pool[idx] == NULL) {
+        rp->free_pages[rp->free_count++] = idx;
+        return 0;
+    }
+    memcpy(rp->pool[idx], encoded, len * sizeof(uint16_t));
+    rp->pool_len[idx] = len;
+    return idx;
+}
+
+static bool page_is_zero(const uint16_t *page) {
+    for (int i = 0; i < REPLAY_PAGE_WORDS; i++) {
+        if (page[i] != 0) return false;
+    }
+    return true;
+}
+
+// --- CHECKPOINTS ---
+
+// Drops every other checkpoint (keeping the first) and doubles the interval,
+// so a long run keeps even coverage with bounded memory.
+static void thin_checkpoints(Replay *rp) {
+    uint32_t kept = 0;
+    for (uint32_t i = 0; i < rp->checkpoint_count; i++) {
+        if (i & 1) {
+            for (int p = 0; p < REPLAY_PAGES; p++) page_release(rp, rp->checkpoints[i].pages[p]);
+        } else {
+            rp->checkpoints[kept++] = rp->checkpoints[i];
+        }
+    }
+    rp->checkpoint_count = kept;
+    rp->interval *= 2;
+}
+
+static void take_checkpoint(Replay *rp, const System *sys) {
+    if (rp->checkpoint_count == REPLAY_MAX_CHECKPOINTS) thin_checkpoints(rp);
+
+    const Checkpoint *prev = rp->checkpoint_count ? &rp->checkpoints[rp->checkpoint_count - 1] : NULL;
+    Checkpoint *cp = &rp->checkpoints[rp->checkpoint_count];
+
+    cp->cycles = sys->cycles;
+    memcpy(cp->registers, sys->registers, sizeof(cp->registers));
+    cp->pc = sys->pc;
+    cp->ir = sys->ir;
+    cp->accum = sys->accum;
+    cp->mar = sys->mar;
+    cp->mbr = sys->mbr;
+    cp->running = sys->running;
+    cp->halt_reason = sys->halt_reason;
+    cp->zero_flag = sys->zero_flag;
+    cp->neg_flag = sys->neg_flag;
+    cp->overflow_flag = sys->overflow_flag;
+    cp->carry_flag = sys->carry_flag;
+
+    // Only pages that differ from the previous checkpoint get a new copy.
+    // The encoding is canonical, so equal pages have equal encodings.
+    uint16_t encoded[RLE_MAX_WORDS];
+    for (int p = 0; p < REPLAY_PAGES; p++) {
+        const uint16_t *cur = &sys->memory[p * REPLAY_PAGE_WORDS];
+        uint32_t old = prev ? prev->pages[p] : 0;
+
+        if (page_is_zero(cur)) {
+            cp->pages[p] = 0;
+            continue;
+        }
+        uint16_t len = rle_encode(cur, encoded);
+        if (len == rp->pool_len[old] && memcmp(encoded, rp->pool[old], len * sizeof(uint16_t)) == 0) {
+            cp->pages[p] = old;
+        } else {
+            uint32_t idx = pool_store(rp, encoded, len);
+            if (idx == 0) {
+                fprintf(stderr, "Replay: out of memory, checkpoints disabled\n");
+                for (int q = 0; q < p; q++) page_release(rp, cp->pages[q]);
+                rp->next_checkpoint = UINT64_MAX;
+                return;
+            }
+            cp->pages[p] = idx;
+        }
+        if (cp->pages[p] != 0) rp->refs[cp->pages[p]]++;
+    }
+
+    rp->checkpoint_count++;
+    rp->next_checkpoint = sys->cycles + rp->interval;
+}
+
+static void restore_checkpoint(Replay *rp, System *sys, const Checkpoint *cp) {
+    sys->cycles = cp->cycles;
+    memcpy(sys->registers, cp->registers, sizeof(cp->registers));
+    sys->pc = cp->pc;
+    sys->ir = cp->ir;
+    sys->accum = cp->accum;
+    sys->mar = cp->mar;
+    sys->mbr = cp->mbr;
+    sys->running = cp->running;
+    sys->halt_reason = cp->halt_reason;
+    sys->zero_flag = cp->zero_flag;
+    sys->neg_flag = cp->neg_flag;
+    sys->overflow_flag = cp->overflow_flag;
+    sys->carry_flag = cp->carry_flag;
+
+    for (int p = 0; p < REPLAY_PAGES; p++) {
+        rle_decode(rp->pool[cp->pages[p]], &sys->memory[p * REPLAY_PAGE_WORDS]);
+    }
+
+    // Rewind the input cursor to the first input not yet delivered at this cycle
+    uint32_t lo = 0, hi = rp->input_count;
+    while (lo < hi) {
+        uint32_t mid = (lo + hi) / 2;
+        if (rp->inputs[mid].cycle < cp->cycles) lo = mid + 1;
+        else hi = mid;
+    }
+    rp->input_pos = lo;
+}
+
+// Index of the last checkpoint at or before `cycle` (checkpoint 0 is at cycle 0)
+static uint32_t find_checkpoint(const Replay *rp, uint64_t cycle) {
+    uint32_t lo = 0, hi = rp->checkpoint_count;
+    while (hi - lo > 1) {
+        uint32_t mid = (lo + hi) / 2;
+        if (rp->checkpoints[mid].cycles <= cycle) lo = mid;
+        else hi = mid;
+    }
+    return lo;
+}
+
+// --- INPUTS ---
+
+static void apply_input(System *sys, const ReplayInput *in) {
+    switch (in->type) {
+        case INPUT_QUIT:
+            sys->running = false;
+            break;
+        case INPUT_WRITE_MEM:
+            sys->memory[in->addr] = in->value;
+            break;
+        case INPUT_WRITE_REG:
+            if (in->addr < 8) {
+                sys->registers[in->addr] = in->value;
+            } else if (in->addr == 8) {
+                sys->pc = in->value;
+            } else {
+                sys->zero_flag = in->value & 1;
+                sys->neg_flag = (in->value >> 1) & 1;
+                sys->overflow_flag = (in->value >> 2) & 1;
+                sys->carry_flag = (in->value >> 3) & 1;
+            }
+            break;
+        default:
+            fprintf(stderr, "Replay: unknown input type %u at cycle %llu\n",
+                    in->type, (unsigned long long)in->cycle);
+    }
+}
+
+static void deliver_inputs(Replay *rp, System *sys) {
+    while (rp->input_pos < rp->input_count && rp->inputs[rp->input_pos].cycle <= sys->cycles) {
+        apply_input(sys, &rp->inputs[rp->input_pos++]);
+    }
+}
+
+// --- PUBLIC API ---
+
+bool replay_init(Replay *rp, const System *sys, uint64_t interval) {
+    memset(rp, 0, sizeof(*rp));
+    rp->interval = interval ? interval : 1;
+
+    rp->pool_cap = REPLAY_PAGES;
+    rp->pool = malloc(rp->pool_cap * sizeof(*rp->pool));
+    rp->pool_len = malloc(rp->pool_cap * sizeof(uint16_t));
+    rp->refs = malloc(rp->pool_cap * sizeof(uint32_t));
+    rp->free_pages = malloc(rp->pool_cap * sizeof(uint32_t));
+    rp->checkpoints = malloc(REPLAY_MAX_CHECKPOINTS * sizeof(Checkpoint));
+    if (!rp->pool || !rp->pool_len || !rp->refs || !rp->free_pages || !rp->checkpoints) {
+        replay_free(rp);
+        return false;
+    }
+
+    // Page 0 of the pool is the shared all-zero page
+    static const uint16_t zero_page[REPLAY_PAGE_WORDS];
+    uint16_t encoded[RLE_MAX_WORDS];
+    uint16_t len = rle_encode(zero_page, encoded);
+    rp->pool[0] = malloc(len * sizeof(uint16_t));
+    if (rp->pool[0] == NULL) {
+        replay_free(rp);
+        return false;
+    }
+    memcpy(rp->pool[0], encoded, len * sizeof(uint16_t));
+    rp->pool_len[0] = len;
+    rp->refs[0] = 0;
+    rp->pool_count = 1;
+
+    take_checkpoint(rp, sys);
+    return rp->checkpoint_count == 1;
+}
+
+void replay_free(Replay *rp) {
+    free(rp->inputs);
+    free(rp->checkpoints);
+    for (uint32_t i = 0; i < rp->pool_count; i++) free(rp->pool[i]);
+    free(rp->pool);
+    free(rp->pool_len);
+    free(rp->refs);
+    free(rp->free_pages);
+    memset(rp, 0, sizeof(*rp));
+}
+
+void replay_step(Replay *rp, System *sys) {
+    deliver_inputs(rp, sys);
+    if (!sys->running) return;
+
+    step_cpu(sys);
+    if (sys->cycles >= rp->next_checkpoint) take_checkpoint(rp, sys);
+    // Inputs recorded at the cycle just reached land before the caller looks at the
+    // machine again, as they did live (e.g. a quit before the frame is drawn)
+    deliver_inputs(rp, sys);
+}
+
+void replay_record_input(Replay *rp, System *sys, uint16_t type, uint16_t addr, uint16_t value) {
+    // A new input after travelling back starts a new timeline: forget the old future
+    if (rp->input_pos < rp->input_count) rp->input_count = rp->input_pos;
+    while (rp->checkpoint_count > 1 && rp->checkpoints[rp->checkpoint_count - 1].cycles > sys->cycles) {
+        Checkpoint *cp = &rp->checkpoints[--rp->checkpoint_count];
+        for (int p = 0; p < REPLAY_PAGES; p++) page_release(rp, cp->pages[p]);
+    }
+    rp->next_checkpoint = rp->checkpoints[rp->checkpoint_count - 1].cycles + rp->interval;
+
+    if (rp->input_count == rp->input_cap) {
+        uint32_t new_cap = rp->input_cap ? rp->input_cap * 2 : 64;
+        ReplayInput *inputs = realloc(rp->inputs, new_cap * sizeof(ReplayInput));
+        if (inputs == NULL) {
+            fprintf(stderr, "Replay: out of memory, input not recorded\n");
+            return;
+        }
+        rp->inputs = inputs;
+        rp->input_cap = new_cap;
+    }
+
+    ReplayInput *in = &rp->inputs[rp->input_count++];
+    in->cycle = sys->cycles;
+    in->type = type;
+    in->addr = addr;
+    in->value = value;
+    rp->input_pos = rp->input_count;
+    apply_input(sys, in);
+}
+
+bool replay_seek(Replay *rp, System *sys, uint64_t target) {
+    const Checkpoint *cp = &rp->checkpoints[find_checkpoint(rp, target)];
+
+    // Restore unless running forward from where we are is already the shortest path
+    if (target < sys->cycles || cp->cycles > sys->cycles) restore_checkpoint(rp, sys, cp);
+
+    while (sys->cycles < target && sys->running) replay_step(rp, sys);
+    // The live run saw inputs at this cycle (e.g. debugger edits) as soon as they arrived
+    deliver_inputs(rp, sys);
+    return sys->cycles == target;
+}
+
+bool replay_step_back(Replay *rp, System *sys) {
+    if (sys->cycles == 0) return false;
+    return replay_seek(rp, sys, sys->cycles - 1);
+}
+
+bool replay_reverse_continue(Replay *rp, System *sys,
+                             bool (*hit)(System *sys, bool ran, void *ctx), void *ctx) {
+    uint64_t now = sys->cycles;
+    if (now == 0) return false;
+
+    // Scan one checkpoint interval at a time, newest first, for the last matching state
+    for (int64_t k = find_checkpoint(rp, now - 1); k >= 0; k--) {
+        uint64_t end = now;
+        if (k + 1 < rp->checkpoint_count && rp->checkpoints[k + 1].cycles < now) {
+            end = rp->checkpoints[k + 1].cycles;
+        }
+
+        restore_checkpoint(rp, sys, &rp->checkpoints[k]);
+        bool found = false;
+        uint64_t at = 0;
+        while (sys->cycles < end && sys->running) {
+            uint64_t before = sys->cycles;
+            bool matched = hit(sys, false, ctx);
+            replay_step(rp, sys);
+            if (hit(sys, true, ctx) || matched) {
+                found = true;
+                at = before;
+            }
+        }
+        if (found) return replay_seek(rp, sys, at);
+    }
+
+    // Nothing matched: stop at the start of recorded history
+    restore_checkpoint(rp, sys, &rp->checkpoints[0]);
+    deliver_inputs(rp, sys);
+    return false;
+}
+
+bool replay_save_inputs(const Replay *rp, const char *path) {
+    FILE *f = fopen(path, "wb");
+    if (f == NULL) {
+        perror("Error opening replay file");
+        return false;
+    }
+
+    uint32_t header[2] = {REPLAY_MAGIC, rp->input_count};
+    fwrite(header, sizeof(uint32_t), 2, f);
+    for (uint32_t i = 0; i < rp->input_count; i++) {
+        fwrite(&rp->inputs[i].cycle, sizeof(uint64_t), 1, f);
+        fwrite(&rp->inputs[i].type, sizeof(uint16_t), 1, f);
+        fwrite(&rp->inputs[i].addr, sizeof(uint16_t), 1, f);
+        fwrite(&rp->inputs[i].value, sizeof(uint16_t), 1, f);
+    }
+
+    bool ok = !ferror(f);
+    fclose(f);
+    return ok;
+}
+
+bool replay_load_inputs(Replay *rp, const char *path) {
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) {
+        perror("Error opening replay file");
+        return false;
+    }
+
+    uint32_t header[2];
+    if (fread(header, sizeof(uint32_t), 2, f) != 2 || header[0] != REPLAY_MAGIC) {
+        fprintf(stderr, "Replay: %s is not a replay file\n", path);
+        fclose(f);
+        return false;
+    }
+
+    ReplayInput *inputs = malloc((header[1] ? header[1] : 1) * sizeof(ReplayInput));
+    if (inputs == NULL) {
+        fclose(f);
+        return false;
+    }
+    for (uint32_t i = 0; i < header[1]; i++) {
+        if (fread(&inputs[i].cycle, sizeof(uint64_t), 1, f) != 1 ||
+            fread(&inputs[i].type, sizeof(uint16_t), 1, f) != 1 ||
+            fread(&inputs[i].addr, sizeof(uint16_t), 1, f) != 1 ||
+            fread(&inputs[i].value, sizeof(uint16_t), 1, f) != 1) {
+            fprintf(stderr, "Replay: %s is truncated\n", path);
+            free(inputs);
+            fclose(f);
+            return false;
+        }
+    }
+    fclose(f);
+
+    free(rp->inputs);
+    rp->inputs = inputs;
+    rp->input_count = header[1];
+    rp->input_cap = header[1] ? header[1] : 1;
+    rp->input_pos = 0;
+    return true;
+}
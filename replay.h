@@ -0,0 +1,90 @@
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "cpu.h"
+
+// Checkpoint Configuration
+#define REPLAY_PAGE_WORDS 256                         // Words per checkpoint page
+#define REPLAY_PAGES (MEM_SIZE / REPLAY_PAGE_WORDS)   // 256 pages cover the address space
+#define REPLAY_MAX_CHECKPOINTS 256                    // Thinned out (interval doubled) when full
+
+// External inputs that can reach the machine
+enum {
+    INPUT_QUIT = 1,      // Window closed (SDL_EVENT_QUIT)
+    INPUT_WRITE_MEM = 2, // Debugger store: memory[addr] = value
+    INPUT_WRITE_REG = 3, // Debugger register write: addr 0-7 = R0-R7, 8 = PC, 9 = flags (bit 0 Z, 1 N, 2 V, 3 C)
+};
+
+// One external input, delivered just before the instruction at `cycle` runs
+typedef struct {
+    uint64_t cycle;
+    uint16_t type;
+    uint16_t addr;
+    uint16_t value;
+} ReplayInput;
+
+// CPU state plus a page table into the shared page pool.
+// Pages that did not change since the previous checkpoint are shared, not copied.
+typedef struct {
+    uint64_t cycles;
+    uint16_t registers[8];
+    uint16_t pc;
+    uint16_t ir;
+    uint16_t accum;
+    uint16_t mar;
+    uint16_t mbr;
+    bool running;
+    uint8_t halt_reason;
+    bool zero_flag;
+    bool neg_flag;
+    bool overflow_flag;
+    bool carry_flag;
+    uint32_t pages[REPLAY_PAGES];
+} Checkpoint;
+
+typedef struct {
+    // Input log
+    ReplayInput *inputs;
+    uint32_t input_count;
+    uint32_t input_cap;
+    uint32_t input_pos;       // Next input to deliver
+
+    // Checkpoints, ordered by cycle
+    Checkpoint *checkpoints;
+    uint32_t checkpoint_count;
+    uint64_t interval;        // Instructions between checkpoints
+    uint64_t next_checkpoint; // Cycle at which the next checkpoint is due
+
+    // Reference counted pool of run-length encoded pages (page 0 is the shared all-zero page)
+    uint16_t **pool;
+    uint16_t *pool_len;       // Encoded length in words
+    uint32_t *refs;
+    uint32_t pool_count;
+    uint32_t pool_cap;
+    uint32_t *free_pages;
+    uint32_t free_count;
+} Replay;
+
+// Function Prototypes
+bool replay_init(Replay *rp, const System *sys, uint64_t interval);
+void replay_free(Replay *rp);
+
+// Live execution: deliver due inputs, run one instruction, checkpoint when due
+void replay_step(Replay *rp, System *sys);
+void replay_record_input(Replay *rp, System *sys, uint16_t type, uint16_t addr, uint16_t value);
+
+// Time travel (all re-execution goes through replay_step, so inputs are replayed)
+bool replay_seek(Replay *rp, System *sys, uint64_t target);
+bool replay_step_back(Replay *rp, System *sys);
+// hit() sees every instruction twice, before it runs (ran = false) and after (ran = true);
+// either match stops at the state before that instruction
+bool replay_reverse_continue(Replay *rp, System *sys,
+                             bool (*hit)(System *sys, bool ran, void *ctx), void *ctx);
+
+// Input log files (the program image plus the log reproduce a run exactly)
+bool replay_save_inputs(const Replay *rp, const char *path);
+bool replay_load_inputs(Replay *rp, const char *path);
+
+#endif
@@ -0,0 +1,302 @@
+#include "smp.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// --- MAILBOXES (caller holds m->lock) ---
+
+static bool mail_push(HartDevice *dev, uint16_t value) {
+    if (dev->mail_count == SMP_MAILBOX_SIZE) return false;
+    dev->mail[(dev->mail_head + dev->mail_count) % SMP_MAILBOX_SIZE] = value;
+    dev->mail_count++;
+    return true;
+}
+
+static uint16_t mail_pop(HartDevice *dev) {
+    if (dev->mail_count == 0) return 0;
+    uint16_t value = dev->mail[dev->mail_head];
+    dev->mail_head = (dev->mail_head + 1) % SMP_MAILBOX_SIZE;
+    dev->mail_count--;
+    return value;
+}
+
+static bool any_mail(const SmpMachine *m) {
+    for (int i = 0; i < m->hart_count; i++) {
+        if (m->devices[i].mail_count && !m->devices[i].retired) return true;
+    }
+    return false;
+}
+
+// Only HLT parks a hart; any other stop (a fault) retires it for good
+static bool can_wake(const System *sys) {
+    return sys->halt_reason == HALT_HLT;
+}
+
+// --- MMIO DEVICE ---
+
+// Atomics follow the LD/ST page rules: code space and the device page itself fault the hart
+static bool atomic_target_ok(System *sys, uint16_t addr) {
+    if (!(sys->page_flags[addr >> PAGE_SHIFT] & (PAGE_NO_ACCESS | PAGE_MMIO))) return true;
+    sys->running = false;
+    sys->halt_reason = HALT_FAULT;
+    return false;
+}
+
+static bool smp_mmio_read(System *sys, uint16_t addr, uint16_t *value) {
+    SmpMachine *m = sys->mmio_ctx;
+    HartDevice *dev = &m->devices[sys->hart_id];
+    uint16_t *target = &sys->memory[dev->atomic_addr];
+
+    switch (addr) {
+        case MMIO_HART_ID:       *value = sys->hart_id; break;
+        case MMIO_HART_COUNT:    *value = m->hart_count; break;
+        case MMIO_ATOMIC_ADDR:   *value = dev->atomic_addr; break;
+        case MMIO_ATOMIC_EXPECT: *value = dev->atomic_expect; break;
+        case MMIO_ATOMIC_VALUE:  *value = dev->atomic_value; break;
+
+        case MMIO_ATOMIC_CAS: {
+            if (!atomic_target_ok(sys, dev->atomic_addr)) break;
+            uint16_t expected = dev->atomic_expect;
+            __atomic_compare_exchange_n(target, &expected, dev->atomic_value, false,
+                                        __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+            *value = expected; // Old value whether or not the swap happened
+            break;
+        }
+        case MMIO_ATOMIC_FADD:
+            if (!atomic_target_ok(sys, dev->atomic_addr)) break;
+            *value = __atomic_fetch_add(target, dev->atomic_value, __ATOMIC_SEQ_CST);
+            break;
+        case MMIO_ATOMIC_SWAP:
+            if (!atomic_target_ok(sys, dev->atomic_addr)) break;
+            *value = __atomic_exchange_n(target, dev->atomic_value, __ATOMIC_SEQ_CST);
+            break;
+
+        case MMIO_FENCE:
+            __atomic_thread_fence(__ATOMIC_SEQ_CST);
+            *value = 0;
+            break;
+
+        case MMIO_MBOX_TARGET: *value = dev->mbox_target; break;
+        case MMIO_MBOX_SEND:   *value = dev->last_send_ok; break;
+
+        case MMIO_MBOX_RECV:
+            pthread_mutex_lock(&m->lock);
+            *value = mail_pop(dev);
+            pthread_mutex_unlock(&m->lock);
+            break;
+        case MMIO_MBOX_COUNT:
+            pthread_mutex_lock(&m->lock);
+            *value = dev->mail_count;
+            pthread_mutex_unlock(&m->lock);
+            break;
+
+        default:
+            if (addr < MMIO_BASE) return false; // Plain heap on the same page
+            *value = 0;                         // Unused registers read as 0
+    }
+    return true;
+}
+
+static bool smp_mmio_write(System *sys, uint16_t addr, uint16_t value) {
+    SmpMachine *m = sys->mmio_ctx;
+    HartDevice *dev = &m->devices[sys->hart_id];
+
+    switch (addr) {
+        case MMIO_ATOMIC_ADDR:   dev->atomic_addr = value; break;
+        case MMIO_ATOMIC_EXPECT: dev->atomic_expect = value; break;
+        case MMIO_ATOMIC_VALUE:  dev->atomic_value = value; break;
+        case MMIO_MBOX_TARGET:   dev->mbox_target = value; break;
+
+        case MMIO_FENCE:
+            __atomic_thread_fence(__ATOMIC_SEQ_CST);
+            break;
+
+        case MMIO_MBOX_SEND:
+            if (dev->mbox_target >= m->hart_count) {
+                dev->last_send_ok = false;
+                break;
+            }
+            pthread_mutex_lock(&m->lock);
+            // A retired hart would never read it
+            dev->last_send_ok = !m->devices[dev->mbox_target].retired &&
+                                mail_push(&m->devices[dev->mbox_target], value);
+            // Release ordering: the receiver sees every store made before the send
+            pthread_cond_broadcast(&m->wake);
+            pthread_mutex_unlock(&m->lock);
+            break;
+
+        default:
+            return addr >= MMIO_BASE; // Writes to read-only or unused registers are ignored
+    }
+    return true;
+}
+
+// --- SETUP ---
+
+bool smp_init(SmpMachine *m, int hart_count, uint32_t quantum, bool deterministic) {
+    memset(m, 0, sizeof(*m));
+    if (hart_count < 1 || hart_count > SMP_MAX_HARTS) return false;
+    pthread_mutex_init(&m->lock, NULL);
+    pthread_cond_init(&m->wake, NULL);
+
+    m->memory = calloc(MEM_SIZE, sizeof(uint16_t));
+    m->harts = malloc(hart_count * sizeof(System));
+    if (m->memory == NULL || m->harts == NULL) {
+        smp_free(m);
+        return false;
+    }
+
+    m->hart_count = hart_count;
+    m->quantum = quantum ? quantum : 1;
+    m->deterministic = deterministic;
+
+    for (int i = 0; i < hart_count; i++) {
+        System *sys = &m->harts[i];
+        init_system(sys, m->memory);
+        sys->page_flags[MMIO_BASE >> PAGE_SHIFT] |= PAGE_MMIO;
+        sys->mmio_read = smp_mmio_read;
+        sys->mmio_write = smp_mmio_write;
+        sys->mmio_ctx = m;
+        sys->hart_id = i;
+    }
+    return true;
+}
+
+void smp_free(SmpMachine *m) {
+    if (m->threads_started) smp_stop(m);
+    pthread_mutex_destroy(&m->lock);
+    pthread_cond_destroy(&m->wake);
+    free(m->harts);
+    free(m->memory);
+    m->harts = NULL;
+    m->memory = NULL;
+}
+
+void smp_load(SmpMachine *m, const uint16_t *program, size_t words) {
+    if (words > MEM_SIZE) words = MEM_SIZE;
+    memcpy(m->memory, program, words * sizeof(uint16_t));
+}
+
+// --- THREADED MODE ---
+
+// HLT parks a hart until a mailbox message arrives. Returns false when the machine stops.
+static bool park(SmpMachine *m, System *sys) {
+    HartDevice *dev = &m->devices[sys->hart_id];
+
+    pthread_mutex_lock(&m->lock);
+    m->parked++;
+    while (dev->mail_count == 0 && !__atomic_load_n(&m->stop, __ATOMIC_ACQUIRE)) {
+        if (m->parked + m->retired == m->hart_count && !any_mail(m)) {
+            // Every hart is parked and nothing can wake them: the program is done
+            __atomic_store_n(&m->stop, true, __ATOMIC_RELEASE);
+            pthread_cond_broadcast(&m->wake);
+            break;
+        }
+        pthread_cond_wait(&m->wake, &m->lock);
+    }
+    m->parked--;
+    bool woken = dev->mail_count > 0 && !__atomic_load_n(&m->stop, __ATOMIC_ACQUIRE);
+    pthread_mutex_unlock(&m->lock);
+
+    if (woken) {
+        sys->running = true;
+        sys->halt_reason = HALT_NONE;
+    }
+    return woken;
+}
+
+// A faulted hart leaves the machine; the run ends once the rest are parked
+static void retire(SmpMachine *m, System *sys) {
+    pthread_mutex_lock(&m->lock);
+    m->devices[sys->hart_id].retired = true;
+    m->retired++;
+    if (m->parked + m->retired == m->hart_count && !any_mail(m)) {
+        __atomic_store_n(&m->stop, true, __ATOMIC_RELEASE);
+    }
+    pthread_cond_broadcast(&m->wake); // Parked harts re-check whether the run is over
+    pthread_mutex_unlock(&m->lock);
+}
+
+static void *hart_thread(void *arg) {
+    System *sys = arg;
+    SmpMachine *m = sys->mmio_ctx;
+
+    while (!__atomic_load_n(&m->stop, __ATOMIC_ACQUIRE)) {
+        if (!sys->running) {
+            if (!can_wake(sys)) {
+                retire(m, sys);
+                break;
+            }
+            if (!park(m, sys)) break;
+        }
+        for (uint32_t i = 0; i < m->quantum && sys->running; i++) step_cpu(sys);
+    }
+    return NULL;
+}
+
+bool smp_start(SmpMachine *m) {
+    __atomic_store_n(&m->stop, false, __ATOMIC_RELEASE);
+    for (int i = 0; i < m->hart_count; i++) {
+        if (pthread_create(&m->threads[i], NULL, hart_thread, &m->harts[i]) != 0) {
+            fprintf(stderr, "Error starting hart %d\n", i);
+            // Stop and join the harts that did start
+            pthread_mutex_lock(&m->lock);
+            __atomic_store_n(&m->stop, true, __ATOMIC_RELEASE);
+            pthread_cond_broadcast(&m->wake);
+            pthread_mutex_unlock(&m->lock);
+            for (int j = 0; j < i; j++) pthread_join(m->threads[j], NULL);
+            return false;
+        }
+    }
+    m->threads_started = true;
+    return true;
+}
+
+void smp_stop(SmpMachine *m) {
+    pthread_mutex_lock(&m->lock);
+    __atomic_store_n(&m->stop, true, __ATOMIC_RELEASE);
+    pthread_cond_broadcast(&m->wake);
+    pthread_mutex_unlock(&m->lock);
+
+    if (m->threads_started) {
+        for (int i = 0; i < m->hart_count; i++) pthread_join(m->threads[i], NULL);
+        m->threads_started = false;
+    }
+}
+
+// --- DETERMINISTIC MODE ---
+
+bool smp_run_round_robin(SmpMachine *m, uint32_t rounds) {
+    for (uint32_t r = 0; r < rounds; r++) {
+        if (__atomic_load_n(&m->stop, __ATOMIC_ACQUIRE)) return false;
+
+        bool any = false;
+        for (int i = 0; i < m->hart_count; i++) {
+            System *sys = &m->harts[i];
+            if (!sys->running && !can_wake(sys)) {
+                m->devices[i].retired = true;
+                continue;
+            }
+            // A parked hart wakes on its turn once it has mail
+            if (!sys->running && m->devices[i].mail_count > 0) {
+                sys->running = true;
+                sys->halt_reason = HALT_NONE;
+            }
+            if (!sys->running) continue;
+
+            any = true;
+            for (uint32_t q = 0; q < m->quantum && sys->running; q++) step_cpu(sys);
+        }
+
+        // Nobody ran and nobody had mail: every hart has halted for good
+        if (!any) {
+            __atomic_store_n(&m->stop, true, __ATOMIC_RELEASE);
+            return false;
+        }
+    }
+    return true;
+}
+
+bool smp_finished(SmpMachine *m) {
+    return __atomic_load_n(&m->stop, __ATOMIC_ACQUIRE);
+}
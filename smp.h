@@ -0,0 +1,77 @@
+#ifndef SMP_H
+#define SMP_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include "cpu.h"
+
+// Configuration
+#define SMP_MAX_HARTS 16
+#define SMP_MAILBOX_SIZE 16
+
+// Device registers, last 16 words of the heap (page 0xDF is flagged PAGE_MMIO).
+// Atomic and mailbox registers are per hart, so setting up an operation is never racy.
+#define MMIO_BASE          0xDFF0
+#define MMIO_HART_ID       0xDFF0 // R: this hart's index
+#define MMIO_HART_COUNT    0xDFF1 // R: number of harts
+#define MMIO_ATOMIC_ADDR   0xDFF2 // RW: target address of the next atomic
+#define MMIO_ATOMIC_EXPECT 0xDFF3 // RW: expected value for CAS
+#define MMIO_ATOMIC_VALUE  0xDFF4 // RW: new value (CAS/SWAP) or addend (FADD)
+#define MMIO_ATOMIC_CAS    0xDFF5 // R: compare-and-swap, returns the old value
+#define MMIO_ATOMIC_FADD   0xDFF6 // R: fetch-and-add, returns the old value
+#define MMIO_ATOMIC_SWAP   0xDFF7 // R: exchange, returns the old value
+#define MMIO_FENCE         0xDFF8 // R/W: full memory barrier
+#define MMIO_MBOX_TARGET   0xDFF9 // RW: hart that MBOX_SEND delivers to
+#define MMIO_MBOX_SEND     0xDFFA // W: queue a word and wake the target (IPI); R: 1 if the last send was delivered
+#define MMIO_MBOX_RECV     0xDFFB // R: pop from this hart's mailbox, 0 when empty
+#define MMIO_MBOX_COUNT    0xDFFC // R: words waiting in this hart's mailbox
+
+typedef struct {
+    uint16_t atomic_addr;
+    uint16_t atomic_expect;
+    uint16_t atomic_value;
+    uint16_t mbox_target;
+    bool last_send_ok;
+
+    // Guarded by SmpMachine.lock
+    uint16_t mail[SMP_MAILBOX_SIZE];
+    int mail_head;
+    int mail_count;
+    bool retired;  // Stopped by a fault (or an unknown halt); mail can no longer wake it
+} HartDevice;
+
+typedef struct {
+    int hart_count;
+    System *harts;   // Each hart's memory points at `memory`
+    HartDevice devices[SMP_MAX_HARTS];
+    uint16_t *memory;
+
+    bool deterministic; // Round-robin on the calling thread instead of one thread per hart
+    uint32_t quantum;   // Instructions a hart runs between checks
+
+    pthread_t threads[SMP_MAX_HARTS];
+    bool threads_started;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    int parked;         // Harts waiting in HLT for an IPI
+    int retired;        // Harts that faulted and will never run again
+    bool stop;          // Accessed with __atomic builtins
+} SmpMachine;
+
+// Function Prototypes
+bool smp_init(SmpMachine *m, int hart_count, uint32_t quantum, bool deterministic);
+void smp_free(SmpMachine *m);
+void smp_load(SmpMachine *m, const uint16_t *program, size_t words);
+
+// Threaded mode
+bool smp_start(SmpMachine *m);
+void smp_stop(SmpMachine *m);
+
+// Deterministic mode: each running hart gets `quantum` instructions per round, in hart order
+bool smp_run_round_robin(SmpMachine *m, uint32_t rounds);
+
+bool smp_finished(SmpMachine *m);
+
+#endif
@@ -0,0 +1,312 @@
+#include "spmd.h"
+#include <stdlib.h>
+#include <string.h>
+
+// The per-lane loops below have a constant trip count and no branches, so
+// GCC/Clang turn each one into a few AVX2/AVX-512 instructions at -O3 with
+// -mavx2 or -mavx512bw. Lanes outside the mask keep their old value.
+#define LANE_LOOP(body) for (int l = 0; l < SPMD_MAX_LANES; l++) { body }
+#define BLEND(old, value, m) ((uint16_t)(((value) & (m)) | ((old) & ~(m))))
+
+bool spmd_init(SpmdMachine *m, int lanes) {
+    memset(m, 0, sizeof(*m));
+    if (lanes < 1 || lanes > SPMD_MAX_LANES) return false;
+
+    m->memory = calloc(lanes, sizeof(*m->memory));
+    if (m->memory == NULL) return false;
+    m->lanes = lanes;
+
+    // Same reset state as init_system, in every lane
+    for (int l = 0; l < lanes; l++) {
+        m->registers[0][l] = 0xFFFF; //SP
+        m->running[l] = 1;
+    }
+    for (int i = 0x01; i < (0x8000 >> PAGE_SHIFT); i++) m->page_flags[i] = PAGE_NO_ACCESS;
+    return true;
+}
+
+void spmd_free(SpmdMachine *m) {
+    free(m->memory);
+    m->memory = NULL;
+}
+
+void spmd_load(SpmdMachine *m, const uint16_t *program, size_t words) {
+    if (words > MEM_SIZE) words = MEM_SIZE;
+    for (int l = 0; l < m->lanes; l++) memcpy(m->memory[l], program, words * sizeof(uint16_t));
+}
+
+bool spmd_set_lane(SpmdMachine *m, int lane, const System *sys) {
+    if (lane < 0 || lane >= m->lanes) return false;
+    memcpy(m->memory[lane], sys->memory, MEM_SIZE * sizeof(uint16_t));
+    m->code_written = true; // The lane may bring its own code
+    for (int r = 0; r < 8; r++) m->registers[r][lane] = sys->registers[r];
+    m->pc[lane] = sys->pc;
+    m->zero_flag[lane] = sys->zero_flag;
+    m->neg_flag[lane] = sys->neg_flag;
+    m->overflow_flag[lane] = sys->overflow_flag;
+    m->carry_flag[lane] = sys->carry_flag;
+    m->running[lane] = sys->running;
+    m->cycles[lane] = sys->cycles;
+    return true;
+}
+
+bool spmd_get_lane(const SpmdMachine *m, int lane, System *sys) {
+    if (lane < 0 || lane >= m->lanes) return false;
+    init_system(sys, sys->memory);
+    memcpy(sys->memory, m->memory[lane], MEM_SIZE * sizeof(uint16_t));
+    for (int r = 0; r < 8; r++) sys->registers[r] = m->registers[r][lane];
+    sys->pc = m->pc[lane];
+    sys->zero_flag = m->zero_flag[lane];
+    sys->neg_flag = m->neg_flag[lane];
+    sys->overflow_flag = m->overflow_flag[lane];
+    sys->carry_flag = m->carry_flag[lane];
+    sys->running = m->running[lane];
+    sys->cycles = m->cycles[lane];
+    return true;
+}
+
+// --- EXECUTE (same semantics as step_cpu, one lane group at a time) ---
+
+static void exec_alu(SpmdMachine *m, const uint16_t *mask, uint16_t instruction, uint16_t opcode, uint16_t dest) {
+    uint16_t *rd = m->registers[dest];
+    uint16_t operand[SPMD_MAX_LANES];
+
+    if (instruction & 1) {
+        uint16_t immd = (instruction >> 1) & 0xFF;
+        LANE_LOOP(operand[l] = immd;)
+    } else {
+        memcpy(operand, m->registers[(instruction >> 1) & 0x7], sizeof(operand));
+    }
+
+    switch (opcode) {
+        case 0x1: LANE_LOOP(rd[l] = BLEND(rd[l], rd[l] + operand[l], mask[l]);) break; // ADD
+        case 0x2: LANE_LOOP(rd[l] = BLEND(rd[l], rd[l] - operand[l], mask[l]);) break; // SUB
+        case 0x3: LANE_LOOP(rd[l] = BLEND(rd[l], (uint32_t)rd[l] * operand[l], mask[l]);) break; // MUL
+        case 0x5: LANE_LOOP(rd[l] = BLEND(rd[l], rd[l] & operand[l], mask[l]);) break; // AND
+        case 0x6: LANE_LOOP(rd[l] = BLEND(rd[l], rd[l] | operand[l], mask[l]);) break; // OR
+        case 0x7: LANE_LOOP(rd[l] = BLEND(rd[l], rd[l] ^ operand[l], mask[l]);) break; // XOR
+        case 0x9: LANE_LOOP(rd[l] = BLEND(rd[l], operand[l], mask[l]);) break;         // MOV
+
+        case 0x4: // DIV has no vector form; a divide by zero halts only that lane
+            for (int l = 0; l < m->lanes; l++) {
+                if (!mask[l]) continue;
+                if (operand[l] == 0) m->running[l] = 0;
+                else rd[l] /= operand[l];
+            }
+            break;
+    }
+}
+
+static void exec_shift(SpmdMachine *m, const uint16_t *mask, uint16_t instruction, uint16_t dest) {
+    uint16_t *rd = m->registers[dest];
+    uint8_t mode = (instruction >> 1) & 0x3;
+    uint16_t amount[SPMD_MAX_LANES];
+
+    if (instruction & 1) {
+        uint16_t imm = (instruction >> 0x3) & 0x3F;
+        LANE_LOOP(amount[l] = imm;)
+    } else {
+        const uint16_t *rs = m->registers[(instruction >> 0x3) & 0x7];
+        LANE_LOOP(amount[l] = (uint8_t)rs[l];)
+    }
+
+    // Same count rule as step_cpu: modulo 32 for shifts, modulo 16 for the rotate
+    LANE_LOOP(amount[l] &= (mode == 3) ? 15 : 31;)
+
+    if (mode == 0) {
+        LANE_LOOP(rd[l] = BLEND(rd[l], (uint32_t)rd[l] << amount[l], mask[l]);)
+    } else if (mode == 1) {
+        LANE_LOOP(rd[l] = BLEND(rd[l], rd[l] >> amount[l], mask[l]);)
+    } else if (mode == 2) {
+        LANE_LOOP(rd[l] = BLEND(rd[l], (int16_t)rd[l] >> amount[l], mask[l]);)
+    } else {
+        LANE_LOOP(rd[l] = BLEND(rd[l], (rd[l] >> amount[l]) | ((uint32_t)rd[l] << (16 - amount[l])), mask[l]);)
+    }
+}
+
+static void exec_cmp(SpmdMachine *m, const uint16_t *mask, uint16_t instruction, uint16_t dest) {
+    const uint16_t *a = m->registers[dest];
+    const uint16_t *b = m->registers[(instruction >> 6) & 0x7];
+
+    LANE_LOOP(
+        uint16_t result = a[l] - b[l];
+        uint16_t z = (result == 0);
+        uint16_t n = (result >> 15) & 1;
+        uint16_t c = (a[l] < b[l]);
+        // Overflow when the operands' signs differ and the result's sign differs from the first
+        uint16_t v = (((a[l] ^ b[l]) & (a[l] ^ result)) >> 15) & 1;
+        m->zero_flag[l] = BLEND(m->zero_flag[l], z, mask[l]);
+        m->neg_flag[l] = BLEND(m->neg_flag[l], n, mask[l]);
+        m->carry_flag[l] = BLEND(m->carry_flag[l], c, mask[l]);
+        m->overflow_flag[l] = BLEND(m->overflow_flag[l], v, mask[l]);
+    )
+}
+
+static void exec_memory(SpmdMachine *m, const uint16_t *mask, uint16_t instruction, bool store) {
+    uint16_t *rd = m->registers[(instruction >> 9) & 0x7];
+    const uint16_t *rb = m->registers[(instruction >> 6) & 0x7];
+    int8_t offset = instruction & 0x3F;
+    if (offset & 0x20) offset |= 0xC0;
+
+    // Gather/scatter into private memories stays scalar
+    for (int l = 0; l < m->lanes; l++) {
+        if (!mask[l]) continue;
+        uint16_t addr = rb[l] + offset;
+        if (m->page_flags[addr >> PAGE_SHIFT] & PAGE_NO_ACCESS) {
+            m->running[l] = 0;
+        } else if (store) {
+            m->memory[l][addr] = rd[l];
+            m->code_written |= addr < 0x8000;
+        } else {
+            rd[l] = m->memory[l][addr];
+        }
+    }
+}
+
+// Lanes that halt are dropped from the mask; the rest fall through to CMP, as in step_cpu
+static void exec_stack(SpmdMachine *m, uint16_t *mask, uint16_t instruction) {
+    uint8_t mode = instruction & 0x3;
+    uint16_t *sp = m->registers[0];
+    const uint16_t *top = m->registers[7];
+
+    for (int l = 0; l < m->lanes; l++) {
+        if (!mask[l]) continue;
+        if (mode == 0 || mode == 2) {
+            if (sp[l] < 0xF000) {
+                // Stack overflow halts the lane before the fall-through
+                m->running[l] = 0;
+                mask[l] = 0;
+                continue;
+            }
+            uint16_t val = (mode == 0) ? m->registers[(instruction >> 2) & 0x7][l] : (instruction >> 2) & 0x3FF;
+            sp[l]--;
+            m->memory[l][top[l]] = val;
+            m->code_written |= top[l] < 0x8000;
+        } else if (mode == 1) {
+            uint16_t val = m->memory[l][top[l]];
+            sp[l]++;
+            m->registers[(instruction >> 2) & 0x7][l] = val;
+        }
+    }
+}
+
+static void exec_branch(SpmdMachine *m, const uint16_t *mask, uint16_t instruction) {
+    uint8_t cond = instruction & 0x7;
+    uint16_t offset = (instruction >> 3) & 0x1FF;
+    if (offset & 0x100) offset |= 0xFE00;
+
+    LANE_LOOP(
+        uint16_t z = m->zero_flag[l];
+        uint16_t n = m->neg_flag[l];
+        uint16_t jump;
+        switch (cond) {
+            case 0: jump = z; break;           // ==
+            case 1: jump = !z; break;          // !=
+            case 2: jump = !n && !z; break;    // >
+            case 3: jump = n; break;           // <
+            case 4: jump = !n || z; break;     // >=
+            case 5: jump = n || z; break;      // <=
+            case 6: jump = 1; break;
+            default: jump = 0;
+        }
+        uint16_t take = mask[l] & (uint16_t)-jump;
+        m->pc[l] = BLEND(m->pc[l], m->pc[l] + offset, take);
+    )
+}
+
+static void exec_func(SpmdMachine *m, const uint16_t *mask, uint16_t instruction) {
+    for (int l = 0; l < m->lanes; l++) {
+        if (!mask[l]) continue;
+        if ((instruction & 1) == 0) {
+            uint16_t offset = (instruction >> 1) & 0x7FF;
+            if (offset & 0x400) offset |= 0xF800;
+            m->registers[0][l]--;
+            m->memory[l][m->registers[7][l]] = m->pc[l];
+            m->code_written |= m->registers[7][l] < 0x8000;
+            m->pc[l] += offset;
+        } else {
+            uint16_t return_addr = m->memory[l][m->registers[7][l]];
+            m->registers[7][l]++;
+            m->pc[l] = return_addr;
+        }
+    }
+}
+
+bool spmd_step(SpmdMachine *m) {
+    // Lowest PC leads: lanes that skipped ahead wait, so diverged branches reconverge
+    uint32_t lead = 0x10000;
+    LANE_LOOP(
+        uint32_t key = m->running[l] ? m->pc[l] : 0x10000;
+        lead = key < lead ? key : lead;
+    )
+    if (lead == 0x10000) return false;
+
+    // 1. Fetch
+    uint16_t pc = lead;
+    uint16_t mask[SPMD_MAX_LANES];
+    LANE_LOOP(mask[l] = (m->running[l] && m->pc[l] == pc) ? 0xFFFF : 0;)
+
+    int leader = 0;
+    while (!mask[leader]) leader++;
+    uint16_t instruction = m->memory[leader][pc];
+
+    // Lanes only disagree on the instruction once one of them has written to code space
+    if (m->code_written) {
+        for (int l = leader + 1; l < m->lanes; l++) {
+            if (mask[l] && m->memory[l][pc] != instruction) mask[l] = 0;
+        }
+    }
+
+    uint32_t active = 0;
+    LANE_LOOP(
+        active += mask[l] & 1;
+        m->pc[l] = BLEND(m->pc[l], m->pc[l] + 1, mask[l]);
+        m->cycles[l] += mask[l] & 1;
+    )
+    m->issues++;
+    m->lane_instructions += active;
+
+    // 2. Decode
+    uint16_t opcode = (instruction >> 12) & 0xF;
+    uint16_t dest   = (instruction >> 9) & 0x7;
+
+    // 3. Execute
+    switch (opcode) {
+        case 0x0: // HLT
+            LANE_LOOP(m->running[l] &= ~mask[l];)
+            break;
+        case 0x1: case 0x2: case 0x3: case 0x4:
+        case 0x5: case 0x6: case 0x7: case 0x9:
+            exec_alu(m, mask, instruction, opcode, dest);
+            break;
+        case 0x8:
+            exec_shift(m, mask, instruction, dest);
+            break;
+        case 0xA:
+            exec_memory(m, mask, instruction, false);
+            break;
+        case 0xB:
+            exec_memory(m, mask, instruction, true);
+            break;
+        case 0xC: // STACK
+            exec_stack(m, mask, instruction);
+            exec_cmp(m, mask, instruction, dest);
+            break;
+        case 0xD:
+            exec_cmp(m, mask, instruction, dest);
+            break;
+        case 0xE:
+            exec_branch(m, mask, instruction);
+            break;
+        case 0xF:
+            exec_func(m, mask, instruction);
+            break;
+    }
+    return true;
+}
+
+uint64_t spmd_run(SpmdMachine *m, uint64_t max_issues) {
+    uint64_t n = 0;
+    while (n < max_issues && spmd_step(m)) n++;
+    return n;
+}
@@ -0,0 +1,48 @@
+#ifndef SPMD_H
+#define SPMD_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "cpu.h"
+
+// Configuration
+#define SPMD_MAX_LANES 32 // 32 x 16-bit = one AVX-512 register, two AVX2 registers
+
+// Many instances of the same program in lockstep, one per lane.
+// Registers and flags are stored structure-of-arrays so each ALU instruction
+// becomes a single masked operation across all lanes. Memory is private per lane.
+typedef struct {
+    int lanes;
+
+    uint16_t registers[8][SPMD_MAX_LANES];
+    uint16_t pc[SPMD_MAX_LANES];
+    uint16_t zero_flag[SPMD_MAX_LANES];     // Flags are 0 or 1 per lane
+    uint16_t neg_flag[SPMD_MAX_LANES];
+    uint16_t overflow_flag[SPMD_MAX_LANES];
+    uint16_t carry_flag[SPMD_MAX_LANES];
+    uint16_t running[SPMD_MAX_LANES];
+    uint64_t cycles[SPMD_MAX_LANES];
+
+    uint16_t (*memory)[MEM_SIZE]; // memory[lane][address], `lanes` entries
+    uint8_t page_flags[NUM_PAGES];
+    bool code_written; // Some lane stored below 0x8000, so fetched instructions may differ
+
+    // Statistics
+    uint64_t issues;            // Instructions issued (one per lane group)
+    uint64_t lane_instructions; // Sum of active lanes over all issues
+} SpmdMachine;
+
+// Function Prototypes
+bool spmd_init(SpmdMachine *m, int lanes);
+void spmd_free(SpmdMachine *m);
+
+void spmd_load(SpmdMachine *m, const uint16_t *program, size_t words); // Same image in every lane
+bool spmd_set_lane(SpmdMachine *m, int lane, const System *sys); // False if lane is out of range
+bool spmd_get_lane(const SpmdMachine *m, int lane, System *sys); // Into sys->memory, which must be set
+
+// Issues one instruction for every running lane at the lowest PC. Returns false once all lanes halted.
+bool spmd_step(SpmdMachine *m);
+uint64_t spmd_run(SpmdMachine *m, uint64_t max_issues);
+
+#endif
@@ -0,0 +1,75 @@
+// Runs random programs on every SPMD lane and on step_cpu, and checks that both
+// engines end in the same state. Build and run from the repository root:
+//   gcc -O3 -mavx2 -I. tests/spmd_equivalence.c spmd.c CPU.c memsim.c -o spmd_equivalence && ./spmd_equivalence
+#include "spmd.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TRIALS 300
+#define PROGRAM_WORDS 64
+#define MAX_ISSUES 2000
+
+// Any instruction except DIV (a zero divisor halts only one SPMD lane), LD/ST and
+// STACK (random addresses fault or rewrite the code) and FUNC. HLT is kept rare.
+static uint16_t random_instruction(void) {
+    for (;;) {
+        uint16_t word = rand() & 0xFFFF;
+        int opcode = word >> 12;
+        if (opcode == 0x4 || opcode == 0xA || opcode == 0xB || opcode == 0xC || opcode == 0xF) continue;
+        if (opcode == 0x0 && rand() % 8) continue;
+        return word;
+    }
+}
+
+static bool same_state(const System *a, const System *b) {
+    return memcmp(a->registers, b->registers, sizeof(a->registers)) == 0 &&
+           a->pc == b->pc && a->running == b->running &&
+           a->zero_flag == b->zero_flag && a->neg_flag == b->neg_flag &&
+           a->overflow_flag == b->overflow_flag && a->carry_flag == b->carry_flag &&
+           memcmp(a->memory, b->memory, MEM_SIZE * sizeof(uint16_t)) == 0;
+}
+
+int main(void) {
+    static uint16_t ref_memory[MEM_SIZE], lane_memory[MEM_SIZE];
+    System ref, lane;
+    lane.memory = lane_memory;
+    SpmdMachine *m = malloc(sizeof(SpmdMachine));
+    if (m == NULL) return 1;
+    srand(1);
+
+    int mismatches = 0;
+    for (int t = 0; t < TRIALS; t++) {
+        uint16_t program[PROGRAM_WORDS];
+        for (int i = 0; i < PROGRAM_WORDS; i++) program[i] = random_instruction();
+
+        if (!spmd_init(m, SPMD_MAX_LANES)) return 1;
+        spmd_load(m, program, PROGRAM_WORDS);
+        uint16_t start[SPMD_MAX_LANES][8];
+        for (int l = 0; l < SPMD_MAX_LANES; l++) {
+            for (int r = 1; r < 8; r++) m->registers[r][l] = rand();
+            for (int r = 0; r < 8; r++) start[l][r] = m->registers[r][l];
+        }
+        spmd_run(m, MAX_ISSUES);
+
+        // Each lane must match a plain CPU run for as many instructions as the lane executed
+        for (int l = 0; l < SPMD_MAX_LANES; l++) {
+            init_system(&ref, ref_memory);
+            memcpy(ref.memory, program, sizeof(program));
+            memcpy(ref.registers, start[l], sizeof(ref.registers));
+            while (ref.cycles < m->cycles[l] && ref.running) step_cpu(&ref);
+
+            spmd_get_lane(m, l, &lane);
+            if (!same_state(&ref, &lane)) {
+                if (mismatches < 3) printf("Mismatch: trial %d lane %d after %llu instructions (pc %04X vs %04X)\n",
+                                           t, l, (unsigned long long)m->cycles[l], ref.pc, lane.pc);
+                mismatches++;
+            }
+        }
+        spmd_free(m);
+    }
+
+    printf("%d of %d lanes differ from step_cpu\n", mismatches, TRIALS * SPMD_MAX_LANES);
+    free(m);
+    return mismatches != 0;
+}